@@ -0,0 +1,290 @@
+/****************************************************************
+ * Benchmark of the hot paths of MethodNeuroBayes, built and run by
+ * "make bench" against the stand-in NeuroBayes libraries in
+ * bench/standin.
+ *
+ * Trains the plugin on a synthetic dataset through the TMVA Factory
+ * and measures
+ *   - event ingestion: from the start of the training to the last
+ *     event passed to the Teacher (InitEventSample)
+ *   - GetMvaValue latency per test event, percentiles in us
+ *   - batch scoring throughput of EvaluateBatch (and of GetMvaValues
+ *     for ROOT >= 6.08), best of --repeat runs
+ *   - expert load time of a Reader booking the weight file, without
+ *     and with the expertise already in the expertise cache
+ * and writes the results as JSON (--output, default nb_bench.json).
+ *
+ *   nb_bench [--events N] [--test-events N] [--vars N] [--repeat N]
+ *            [--iterations N] [--options "TMVA options"] [--output file]
+ * *************************************************************/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include <RVersion.h>
+#include <TFile.h>
+#include <TTree.h>
+#include <TString.h>
+#include <TSystem.h>
+#include <TRandom3.h>
+#include "TMVA/Tools.h"
+#include "TMVA/Factory.h"
+#include "TMVA/Reader.h"
+#include "TMVA/DataSet.h"
+#include "TMVA/Event.h"
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,8,0)
+#include "TMVA/DataLoader.h"
+#endif
+
+#include "MethodNeuroBayes.h"
+
+namespace {
+	struct Config {
+		Long64_t events;      // training events, half of them signal
+		Long64_t testEvents;
+		Int_t    vars;
+		Int_t    repeat;
+		Int_t    iterations;
+		TString  options;     // appended to the booking options
+		TString  output;
+	};
+
+	Double_t Now() {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec + 1.e-9*ts.tv_nsec;
+	}
+
+	Double_t WallClock() {
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		return ts.tv_sec + 1.e-9*ts.tv_nsec;
+	}
+
+	Double_t Percentile( const std::vector<Double_t>& sorted, Double_t fraction ) {
+		if (sorted.empty()) return 0;
+		const size_t i = std::min(sorted.size() - 1, size_t(fraction*sorted.size()));
+		return sorted[i];
+	}
+
+	Double_t Median( std::vector<Double_t> values ) {
+		std::sort(values.begin(), values.end());
+		return Percentile(values, 0.5);
+	}
+
+	// s as the contents of a JSON string
+	TString JsonEscape( const TString& s ) {
+		TString escaped;
+		for (Ssiz_t i=0; i<s.Length(); i++) {
+			const unsigned char c = s[i];
+			if (c == '"' || c == '\\') escaped += TString::Format("\\%c", c);
+			else if (c < 0x20) escaped += TString::Format("\\u%04x", c);
+			else escaped += char(c);
+		}
+		return escaped;
+	}
+
+	void Usage() {
+		printf("usage: nb_bench [--events N] [--test-events N] [--vars N] [--repeat N]\n"
+		       "                [--iterations N] [--options \"TMVA options\"] [--output file]\n");
+	}
+
+	Bool_t ParseArguments( int argc, char** argv, Config& config ) {
+		config.events     = 100000;
+		config.testEvents = -1;
+		config.vars       = 10;
+		config.repeat     = 5;
+		config.iterations = 10;
+		config.options    = "";
+		config.output     = "nb_bench.json";
+		for (int i=1; i<argc; i++) {
+			const char* arg = argv[i];
+			if (i + 1 >= argc) return kFALSE;
+			const char* value = argv[++i];
+			if      (!strcmp(arg, "--events"))      config.events     = atoll(value);
+			else if (!strcmp(arg, "--test-events")) config.testEvents = atoll(value);
+			else if (!strcmp(arg, "--vars"))        config.vars       = atoi(value);
+			else if (!strcmp(arg, "--repeat"))      config.repeat     = atoi(value);
+			else if (!strcmp(arg, "--iterations"))  config.iterations = atoi(value);
+			else if (!strcmp(arg, "--options"))     config.options    = value;
+			else if (!strcmp(arg, "--output"))      config.output     = value;
+			else return kFALSE;
+		}
+		if (config.testEvents < 0) config.testEvents = config.events;
+		return config.events >= 2 && config.testEvents >= 2 && config.vars > 0 && config.repeat > 0;
+	}
+
+	// nvar correlated gaussians, the signal shifted by a different amount
+	// in every variable
+	TTree* MakeTree( const char* name, Bool_t signal, Long64_t nevents, Int_t nvar, TRandom3& random ) {
+		TTree* tree = new TTree(name, name);
+		std::vector<Float_t> x(nvar);
+		for (Int_t ivar=0; ivar<nvar; ivar++) tree->Branch(Form("var%d", ivar), &x[ivar], Form("var%d/F", ivar));
+		for (Long64_t ievt=0; ievt<nevents; ievt++) {
+			const Double_t common = random.Gaus();
+			for (Int_t ivar=0; ivar<nvar; ivar++) {
+				const Double_t shift = signal ? 0.5*(ivar%4 + 1)/4. : 0;
+				x[ivar] = random.Gaus(shift, 1.) + 0.3*common;
+			}
+			tree->Fill();
+		}
+		return tree;
+	}
+
+	template <class Loader>
+	void DefineDataset( Loader* loader, const Config& config, TTree* signal, TTree* background ) {
+		for (Int_t ivar=0; ivar<config.vars; ivar++) loader->AddVariable(Form("var%d", ivar), 'F');
+		loader->AddSignalTree(signal, 1.0);
+		loader->AddBackgroundTree(background, 1.0);
+		const Long64_t ntrain = config.events/2, ntest = config.testEvents/2;
+		loader->PrepareTrainingAndTestTree("", Form("nTrain_Signal=%lld:nTrain_Background=%lld:nTest_Signal=%lld:nTest_Background=%lld:SplitMode=Block:NormMode=None:!V",
+							ntrain, ntrain, ntest, ntest));
+	}
+
+	// seconds a new Reader takes to book the weight file
+	Double_t LoadExpert( std::vector<Float_t>& vars, const TString& weightFile, TMVA::Reader*& reader ) {
+		reader = new TMVA::Reader("!Color:Silent");
+		for (UInt_t ivar=0; ivar<vars.size(); ivar++) reader->AddVariable(Form("var%d", ivar), &vars[ivar]);
+		const Double_t start = Now();
+		reader->BookMVA("NeuroBayes", weightFile);
+		return Now() - start;
+	}
+}
+
+int main( int argc, char** argv )
+{
+	Config config;
+	if (!ParseArguments(argc, argv, config)) {
+		Usage();
+		return 1;
+	}
+
+	TMVA::Tools::Instance();
+	TMVA::MethodNeuroBayes::RegisterNeuroBayes();
+	gSystem->mkdir("weights", kTRUE);
+
+	TRandom3 random(4711);
+	const Long64_t nperclass = (config.events + config.testEvents)/2;
+	TFile* output = TFile::Open("nb_bench_tmva.root", "RECREATE");
+	TTree* signal = MakeTree("signal", kTRUE, nperclass, config.vars, random);
+	TTree* background = MakeTree("background", kFALSE, nperclass, config.vars, random);
+
+	TString options = Form("!H:!V:Analysis=False:NtrainingIter=%d", config.iterations);
+	if (config.options != "") options += ":" + config.options;
+	TMVA::Factory* factory = new TMVA::Factory("nb_bench", output, "!V:Silent:!Color:!DrawProgressBar:AnalysisType=Classification");
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,8,0)
+	TMVA::DataLoader* loader = new TMVA::DataLoader("nb_bench");
+	DefineDataset(loader, config, signal, background);
+	TMVA::MethodBase* booked = factory->BookMethod(loader, TMVA::Types::kPlugins, "NeuroBayes", options);
+#else
+	DefineDataset(factory, config, signal, background);
+	TMVA::MethodBase* booked = factory->BookMethod(TMVA::Types::kPlugins, "NeuroBayes", options);
+#endif
+	TMVA::MethodNeuroBayes* method = dynamic_cast<TMVA::MethodNeuroBayes*>(booked);
+	if (!method) {
+		fprintf(stderr, "nb_bench: booking NeuroBayes failed\n");
+		return 1;
+	}
+
+	// training; the stand-in Teacher knows when the last event arrived
+	NeuroBayesTeacher* teacher = NeuroBayesTeacher::Instance();
+	const Double_t trainStart = WallClock();
+	factory->TrainAllMethods();
+	const Double_t trainSeconds = WallClock() - trainStart;
+	const Double_t ingestSeconds = teacher->GetLastInputTime() - trainStart;
+	const Long64_t ingested = teacher->GetNInputs();
+
+	// GetMvaValue latency, one test event at a time
+	TMVA::DataSet* data = method->Data();
+	data->SetCurrentType(TMVA::Types::kTesting);
+	const Long64_t ntest = data->GetNEvents();
+	const UInt_t nvar = method->GetNvar();
+	std::vector<Double_t> latency(ntest);
+	Double_t sum = 0;
+	for (Long64_t ievt=0; ievt<ntest; ievt++) {
+		data->SetCurrentEvent(ievt);
+		const Double_t start = Now();
+		sum += method->GetMvaValue();
+		latency[ievt] = 1.e6*(Now() - start);
+	}
+	std::sort(latency.begin(), latency.end());
+	Double_t meanLatency = 0;
+	for (Long64_t ievt=0; ievt<ntest; ievt++) meanLatency += latency[ievt]/ntest;
+
+	// batch scoring of the gathered test inputs
+	std::vector<Double_t> inputs(ntest*nvar), values(ntest);
+	for (Long64_t ievt=0; ievt<ntest; ievt++) {
+		const TMVA::Event* event = method->GetTestingEvent(ievt);
+		for (UInt_t ivar=0; ivar<nvar; ivar++) inputs[ievt*nvar + ivar] = event->GetValue(ivar);
+	}
+	Double_t bestBatch = -1;
+	for (Int_t r=0; r<config.repeat; r++) {
+		const Double_t start = Now();
+		method->EvaluateBatch(&inputs[0], ntest, &values[0]);
+		const Double_t seconds = Now() - start;
+		if (bestBatch < 0 || seconds < bestBatch) bestBatch = seconds;
+	}
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,8,0)
+	Double_t bestValues = -1;
+	for (Int_t r=0; r<config.repeat; r++) {
+		const Double_t start = Now();
+		method->GetMvaValues(0, ntest, kFALSE);
+		const Double_t seconds = Now() - start;
+		if (bestValues < 0 || seconds < bestValues) bestValues = seconds;
+	}
+#endif
+
+	// expert load from the weight file: cold, and while another Reader
+	// holds the expertise in the expertise cache
+	const TString weightFile = method->GetWeightFileName();
+	std::vector<Float_t> readerVars(config.vars);
+	std::vector<Double_t> cold, cached;
+	TMVA::Reader* reader = 0;
+	for (Int_t r=0; r<config.repeat; r++) {
+		cold.push_back(LoadExpert(readerVars, weightFile, reader));
+		delete reader;
+	}
+	TMVA::Reader* held = 0;
+	LoadExpert(readerVars, weightFile, held);
+	for (Int_t r=0; r<config.repeat; r++) {
+		cached.push_back(LoadExpert(readerVars, weightFile, reader));
+		delete reader;
+	}
+	delete held;
+
+	FILE* json = fopen(config.output, "w");
+	if (!json) {
+		fprintf(stderr, "nb_bench: cannot write %s\n", config.output.Data());
+		return 1;
+	}
+	fprintf(json, "{\n");
+	fprintf(json, "  \"root_version\": \"%s\",\n", ROOT_RELEASE);
+	fprintf(json, "  \"config\": { \"events\": %lld, \"test_events\": %lld, \"vars\": %d, \"repeat\": %d, \"iterations\": %d, \"options\": \"%s\" },\n",
+		config.events, ntest, config.vars, config.repeat, config.iterations, JsonEscape(options).Data());
+	fprintf(json, "  \"ingest\": { \"events\": %lld, \"seconds\": %.6f, \"events_per_s\": %.1f },\n",
+		ingested, ingestSeconds, ingestSeconds > 0 ? ingested/ingestSeconds : 0.);
+	fprintf(json, "  \"train\": { \"seconds\": %.6f, \"teacher_seconds\": %.6f },\n", trainSeconds, teacher->GetTrainTime());
+	fprintf(json, "  \"get_mva_value_us\": { \"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"p999\": %.4f, \"max\": %.4f },\n",
+		meanLatency, Percentile(latency, 0.5), Percentile(latency, 0.9), Percentile(latency, 0.99),
+		Percentile(latency, 0.999), latency.back());
+	fprintf(json, "  \"evaluate_batch\": { \"events\": %lld, \"seconds\": %.6f, \"events_per_s\": %.1f },\n",
+		ntest, bestBatch, bestBatch > 0 ? ntest/bestBatch : 0.);
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,8,0)
+	fprintf(json, "  \"get_mva_values\": { \"events\": %lld, \"seconds\": %.6f, \"events_per_s\": %.1f },\n",
+		ntest, bestValues, bestValues > 0 ? ntest/bestValues : 0.);
+#endif
+	fprintf(json, "  \"expert_load_ms\": { \"cold_median\": %.4f, \"cold_min\": %.4f, \"cached_median\": %.4f },\n",
+		1.e3*Median(cold), 1.e3**std::min_element(cold.begin(), cold.end()), 1.e3*Median(cached));
+	fprintf(json, "  \"response_mean\": %.9g\n", sum/ntest);
+	fprintf(json, "}\n");
+	fclose(json);
+	printf("nb_bench: results written to %s\n", config.output.Data());
+
+	delete factory;
+	output->Close();
+	return 0;
+}
@@ -0,0 +1,40 @@
+/****************************************************************
+ * Stand-in for the NeuroBayes Expert of libNeuroBayesExpertCPP,
+ * used by "make bench". Evaluates the expertises written by the
+ * stand-in Teacher (layout as described in NeuroBayesNativeNet.cxx)
+ * in double precision; the response is in [-1,1].
+ * *************************************************************/
+
+#ifndef NEUROBAYES_STANDIN_EXPERT
+#define NEUROBAYES_STANDIN_EXPERT
+
+#include <vector>
+
+class Expert {
+
+public:
+	Expert( const char* filename, int mode = -2 );
+	Expert( const float* expertise, int mode = -2 );
+
+	float nb_expert( double* inputs, double = 0., double = 0. );
+	float nb_expert( float* inputs, double = 0., double = 0. );
+
+private:
+	void   Setup( const float* expertise, unsigned long size );
+	double Flatten( int ivar, double value ) const;
+	template <class T> float Evaluate( const T* inputs );
+
+	int fNvar;
+	int fNhidden;
+	int fNknots;
+	bool fDecorrelate;
+	std::vector<int>    fHasMissing;
+	std::vector<double> fMissingValue;
+	std::vector<double> fKnotX, fKnotY;   // [nvar][nknots]
+	std::vector<double> fDecorr;          // [nvar][nvar]
+	std::vector<double> fW1;              // [nhidden][nvar+1]
+	std::vector<double> fW2;              // [nhidden+1]
+	std::vector<double> fX, fH;           // scratch
+};
+
+#endif
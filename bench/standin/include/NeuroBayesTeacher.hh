@@ -0,0 +1,105 @@
+/****************************************************************
+ * Stand-in for the NeuroBayes Teacher of libNeuroBayesTeacherCPP,
+ * used by "make bench" to build and time the plugin without the
+ * proprietary libraries. Implements the calls MethodNeuroBayes makes.
+ *
+ * TrainNet fits a small deterministic network: every input is
+ * flattened through a table of weighted quantiles, then NB_DEF_ITER
+ * full-batch gradient steps minimise the entropy loss of a network
+ * with one hidden layer of symmetric sigmoid nodes, starting from
+ * weights drawn with the NB_RANVIN seeds. A further TrainNet call
+ * continues from the current weights, SetInitialExpertise (after the
+ * inputs) starts it from those of an expertise. The expertise is written in
+ * the layout NeuroBayesNativeNet reads, one "iteration N entropy X"
+ * line per iteration goes to stdout. All other settings are accepted
+ * and ignored. Not a substitute for NeuroBayes in any physics sense.
+ * *************************************************************/
+
+#ifndef NEUROBAYES_STANDIN_TEACHER
+#define NEUROBAYES_STANDIN_TEACHER
+
+#include <string>
+#include <vector>
+
+// the Teacher can start from the tables and weights of an expertise
+#define NEUROBAYES_TEACHER_WARMSTART 1
+
+class NeuroBayesTeacher {
+
+public:
+	static NeuroBayesTeacher* Instance();
+
+	void SetOutputFile( const char* filename );
+
+	void NB_DEF_NODE1( int nodes );
+	void NB_DEF_NODE2( int nodes );
+	void NB_DEF_NODE3( int nodes );
+	void NB_DEF_TASK( const char* task );
+	void NB_RANVIN( int& seed1, int& seed2, int debug );
+	void NB_DEF_PRE( int flag );
+	void NB_DEF_REG( const char* ) {}
+	void NB_DEF_LOSS( const char* ) {}
+	void NB_DEF_SHAPE( const char* ) {}
+	void NB_DEF_EPOCH( int ) {}
+	void NB_DEF_MOM( float ) {}
+	void NB_DEF_SPEED( float speed );
+	void NB_DEF_MAXLEARN( float ) {}
+	void NB_DEF_ITER( int niter );
+	void NB_DEF_METHOD( const char* ) {}
+	void NB_DEF_INITIALPRUNE( int ) {}
+	void NB_DEF_RTRAIN( float ) {}
+	void SetIndividualPreproFlag( int ivar, int flag, const char* name = "" );
+	void SetIndividualPreproParameter( int, int, float ) {}
+
+	void SetWeight( float weight, float = 1. );
+	void SetTarget( float target );
+	void SetNextInput( int nvar, float* inputs );
+	void TrainNet( bool = true );
+	// tables and weights of an expertise of the same topology, false if it
+	// does not fit; applies to the next TrainNet on the current inputs
+	bool SetInitialExpertise( const float* expertise, int size );
+
+	// text file of the correlations of the inputs to the target
+	void nb_correl_signi( char** varnames, const char* textFile, const char* htmlFile );
+
+	// stand-in only, for the benchmark
+	long   GetNInputs() const        { return long(fTarget.size()); }
+	double GetLastInputTime() const  { return fLastInputTime; } // wall clock, s since the epoch
+	double GetTrainTime() const      { return fTrainTime; }     // wall s of the last TrainNet
+
+private:
+	NeuroBayesTeacher();
+
+	void   Reset();
+	void   BuildTables();
+	void   InitWeights();
+	double Forward( const float* x, double* hidden ) const;
+	double Flatten( int ivar, float value ) const;
+	void   WriteExpertise() const;
+	double Random();
+
+	std::string fOutputFile;
+	int    fNodes1, fNodes2, fNodes3;
+	int    fPre;
+	int    fNiter;
+	double fSpeed;
+	unsigned long fSeed;
+	std::vector<int> fPreproFlags;
+
+	std::vector<float> fInputs; // [nevents][nvar]
+	std::vector<float> fTarget;
+	std::vector<float> fWeight;
+	float  fNextWeight;
+	float  fNextTarget;
+	bool   fTrained;            // events arrive for a new training
+
+	std::vector<float>  fKnotX, fKnotY; // [nvar][kNknots]
+	std::vector<double> fW1;    // [nodes2-1][nodes1]
+	std::vector<double> fW2;    // [nodes2]
+	double fLastInputTime;
+	double fTrainTime;
+
+	static const int kNknots = 21;
+};
+
+#endif
@@ -0,0 +1,118 @@
+/****************************************************************
+ * Stand-in NeuroBayes Expert, see NeuroBayesExpert.hh
+ * *************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+#include "NeuroBayesExpert.hh"
+
+namespace {
+	enum { kNodes1, kNodes2, kNodes3, kPre, kNknots, kDecorr, kHeaderSize };
+
+	double Sigmoid( double x ) { return 2./(1. + std::exp(-x)) - 1.; }
+
+	// expected length of an expertise from its header, 0 if invalid
+	unsigned long ExpertiseSize( const float* header ) {
+		const int nodes1 = int(header[kNodes1]), nodes2 = int(header[kNodes2]), nodes3 = int(header[kNodes3]);
+		const int nknots = int(header[kNknots]);
+		if (nodes1 < 2 || nodes2 < 2 || nodes3 != 1 || nknots < 0) return 0;
+		const unsigned long nvar = nodes1 - 1;
+		return kHeaderSize + nvar*(3 + 2*nknots) + (header[kDecorr] != 0 ? nvar*nvar : 0)
+			+ (unsigned long)(nodes2 - 1)*nodes1 + nodes2;
+	}
+}
+
+Expert::Expert( const char* filename, int )
+	: fNvar(0), fNhidden(0), fNknots(0), fDecorrelate(false)
+{
+	std::ifstream in(filename);
+	std::vector<float> expertise;
+	float value;
+	while (in >> value) expertise.push_back(value);
+	if (expertise.size() < kHeaderSize || expertise.size() != ExpertiseSize(&expertise[0])) {
+		fprintf(stderr, "Expert stand-in: %s is not a stand-in expertise\n", filename);
+		return;
+	}
+	Setup(&expertise[0], expertise.size());
+}
+
+Expert::Expert( const float* expertise, int )
+	: fNvar(0), fNhidden(0), fNknots(0), fDecorrelate(false)
+{
+	const unsigned long size = ExpertiseSize(expertise);
+	if (size == 0) {
+		fprintf(stderr, "Expert stand-in: not a stand-in expertise\n");
+		return;
+	}
+	Setup(expertise, size);
+}
+
+void Expert::Setup( const float* expertise, unsigned long )
+{
+	fNvar        = int(expertise[kNodes1]) - 1;
+	fNhidden     = int(expertise[kNodes2]) - 1;
+	fNknots      = int(expertise[kNknots]);
+	fDecorrelate = expertise[kDecorr] != 0;
+	const float* p = expertise + kHeaderSize;
+	fHasMissing.resize(fNvar);
+	fMissingValue.resize(fNvar);
+	fKnotX.resize(size_t(fNvar)*fNknots);
+	fKnotY.resize(size_t(fNvar)*fNknots);
+	for (int ivar=0; ivar<fNvar; ivar++) {
+		p++; // preprocessing flag, already applied to the tables
+		fHasMissing[ivar]   = *p++ != 0;
+		fMissingValue[ivar] = *p++;
+		for (int k=0; k<fNknots; k++) fKnotX[ivar*fNknots + k] = *p++;
+		for (int k=0; k<fNknots; k++) fKnotY[ivar*fNknots + k] = *p++;
+	}
+	fDecorr.assign(p, p + (fDecorrelate ? fNvar*fNvar : 0));
+	p += fDecorr.size();
+	fW1.assign(p, p + fNhidden*(fNvar + 1));
+	p += fW1.size();
+	fW2.assign(p, p + fNhidden + 1);
+	fX.resize(fNvar + 1);
+	fH.resize(fNvar + 1);
+}
+
+double Expert::Flatten( int ivar, double value ) const
+{
+	if (fHasMissing[ivar] && value == fMissingValue[ivar]) return 0;
+	if (fNknots == 0) return value;
+	const double* kx = &fKnotX[ivar*fNknots];
+	const double* ky = &fKnotY[ivar*fNknots];
+	if (value <= kx[0]) return ky[0];
+	if (value >= kx[fNknots-1]) return ky[fNknots-1];
+	const int k = std::upper_bound(kx, kx + fNknots, value) - kx - 1;
+	const double dx = kx[k+1] - kx[k];
+	return dx > 0 ? ky[k] + (ky[k+1] - ky[k])*(value - kx[k])/dx : ky[k];
+}
+
+template <class T>
+float Expert::Evaluate( const T* inputs )
+{
+	if (fNvar == 0) return 0;
+	for (int ivar=0; ivar<fNvar; ivar++) fX[ivar] = Flatten(ivar, inputs[ivar]);
+	if (fDecorrelate) {
+		for (int i=0; i<fNvar; i++) {
+			double s = 0;
+			for (int j=0; j<fNvar; j++) s += fDecorr[i*fNvar + j]*fX[j];
+			fH[i] = s;
+		}
+		std::copy(fH.begin(), fH.begin() + fNvar, fX.begin());
+	}
+	fX[fNvar] = 1;
+	double out = fW2[fNhidden];
+	for (int h=0; h<fNhidden; h++) {
+		const double* w = &fW1[h*(fNvar + 1)];
+		double a = 0;
+		for (int i=0; i<=fNvar; i++) a += w[i]*fX[i];
+		out += fW2[h]*Sigmoid(a);
+	}
+	return Sigmoid(out);
+}
+
+float Expert::nb_expert( double* inputs, double, double ) { return Evaluate(inputs); }
+float Expert::nb_expert( float* inputs, double, double )  { return Evaluate(inputs); }
@@ -0,0 +1,268 @@
+/****************************************************************
+ * Stand-in NeuroBayes Teacher, see NeuroBayesTeacher.hh
+ * *************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <utility>
+#include <sys/time.h>
+
+#include "NeuroBayesTeacher.hh"
+
+namespace {
+	double WallTime() {
+		struct timeval tv;
+		gettimeofday(&tv, 0);
+		return tv.tv_sec + 1.e-6*tv.tv_usec;
+	}
+
+	double Sigmoid( double x ) { return 2./(1. + std::exp(-x)) - 1.; }
+}
+
+NeuroBayesTeacher* NeuroBayesTeacher::Instance()
+{
+	static NeuroBayesTeacher teacher;
+	return &teacher;
+}
+
+NeuroBayesTeacher::NeuroBayesTeacher()
+	: fOutputFile("expert.nb"), fNodes1(2), fNodes2(2), fNodes3(1), fPre(12), fNiter(100), fSpeed(1),
+	  fSeed(4701), fNextWeight(1), fNextTarget(0), fTrained(false), fLastInputTime(0), fTrainTime(0)
+{
+}
+
+void NeuroBayesTeacher::SetOutputFile( const char* filename ) { fOutputFile = filename; }
+void NeuroBayesTeacher::NB_DEF_NODE1( int nodes ) { fNodes1 = nodes; fPreproFlags.assign(std::max(nodes - 1, 0), -1); }
+void NeuroBayesTeacher::NB_DEF_NODE2( int nodes ) { fNodes2 = nodes; }
+void NeuroBayesTeacher::NB_DEF_NODE3( int nodes ) { fNodes3 = nodes; }
+void NeuroBayesTeacher::NB_DEF_TASK( const char* ) {}
+void NeuroBayesTeacher::NB_RANVIN( int& seed1, int& seed2, int ) { fSeed = (unsigned long)(seed1)*100003UL + seed2; }
+void NeuroBayesTeacher::NB_DEF_PRE( int flag ) { fPre = flag; }
+void NeuroBayesTeacher::NB_DEF_SPEED( float speed ) { fSpeed = speed; }
+void NeuroBayesTeacher::NB_DEF_ITER( int niter ) { fNiter = niter; }
+
+void NeuroBayesTeacher::SetIndividualPreproFlag( int ivar, int flag, const char* )
+{
+	if (ivar >= 0 && ivar < int(fPreproFlags.size())) fPreproFlags[ivar] = flag;
+}
+
+void NeuroBayesTeacher::SetWeight( float weight, float ) { fNextWeight = weight; }
+void NeuroBayesTeacher::SetTarget( float target ) { fNextTarget = target; }
+
+void NeuroBayesTeacher::SetNextInput( int nvar, float* inputs )
+{
+	if (fTrained) Reset();
+	const int nexpected = fNodes1 - 1;
+	for (int ivar=0; ivar<nexpected; ivar++) fInputs.push_back(ivar < nvar ? inputs[ivar] : 0.f);
+	fTarget.push_back(fNextTarget);
+	fWeight.push_back(fNextWeight);
+	fNextWeight = 1;
+	fLastInputTime = WallTime();
+}
+
+void NeuroBayesTeacher::Reset()
+{
+	fInputs.clear();
+	fTarget.clear();
+	fWeight.clear();
+	fW1.clear();
+	fW2.clear();
+	fTrained = false;
+}
+
+double NeuroBayesTeacher::Random()
+{
+	// 64 bit LCG, uniform in [-1,1)
+	fSeed = fSeed*6364136223846793005UL + 1442695040888963407UL;
+	return double(fSeed >> 11)/double(1UL << 52) - 1.;
+}
+
+void NeuroBayesTeacher::BuildTables()
+{
+	// weighted quantiles of every input, mapped linearly onto [-1,1]
+	const int nvar = fNodes1 - 1;
+	const long nevents = fTarget.size();
+	fKnotX.assign(size_t(nvar)*kNknots, 0);
+	fKnotY.assign(size_t(nvar)*kNknots, 0);
+	std::vector<std::pair<float, float> > column(nevents);
+	for (int ivar=0; ivar<nvar; ivar++) {
+		double sumw = 0;
+		for (long ievt=0; ievt<nevents; ievt++) {
+			const float w = std::max(fWeight[ievt], 0.f);
+			column[ievt] = std::make_pair(fInputs[ievt*nvar + ivar], w);
+			sumw += w;
+		}
+		std::sort(column.begin(), column.end());
+		double cumulated = 0;
+		long ievt = 0;
+		for (int k=0; k<kNknots; k++) {
+			const double quantile = sumw*k/(kNknots - 1);
+			while (ievt + 1 < nevents && cumulated + column[ievt].second < quantile) cumulated += column[ievt++].second;
+			fKnotX[ivar*kNknots + k] = nevents > 0 ? column[ievt].first : 0;
+			fKnotY[ivar*kNknots + k] = -1. + 2.*k/(kNknots - 1);
+		}
+	}
+}
+
+double NeuroBayesTeacher::Flatten( int ivar, float value ) const
+{
+	const float* kx = &fKnotX[ivar*kNknots];
+	const float* ky = &fKnotY[ivar*kNknots];
+	if (value <= kx[0]) return ky[0];
+	if (value >= kx[kNknots-1]) return ky[kNknots-1];
+	const int k = std::upper_bound(kx, kx + kNknots, value) - kx - 1;
+	const double dx = kx[k+1] - kx[k];
+	return dx > 0 ? ky[k] + (ky[k+1] - ky[k])*(value - kx[k])/dx : ky[k];
+}
+
+void NeuroBayesTeacher::InitWeights()
+{
+	const int nhidden = fNodes2 - 1;
+	fW1.resize(size_t(nhidden)*fNodes1);
+	fW2.resize(fNodes2);
+	const double scale = 1./std::sqrt(double(fNodes1));
+	for (size_t i=0; i<fW1.size(); i++) fW1[i] = scale*Random();
+	for (size_t i=0; i<fW2.size(); i++) fW2[i] = 0.5*Random();
+}
+
+double NeuroBayesTeacher::Forward( const float* x, double* hidden ) const
+{
+	const int nhidden = fNodes2 - 1;
+	double out = 0;
+	for (int h=0; h<nhidden; h++) {
+		const double* w = &fW1[h*fNodes1];
+		double a = 0;
+		for (int i=0; i<fNodes1; i++) a += w[i]*x[i];
+		hidden[h] = Sigmoid(a);
+		out += fW2[h]*hidden[h];
+	}
+	hidden[nhidden] = 1;
+	return out + fW2[nhidden];
+}
+
+void NeuroBayesTeacher::TrainNet( bool )
+{
+	const double start = WallTime();
+	const int nvar = fNodes1 - 1;
+	const int nhidden = fNodes2 - 1;
+	const long nevents = fTarget.size();
+	if (fW1.empty()) {
+		BuildTables();
+		InitWeights();
+	}
+
+	// flattened inputs with the bias node
+	std::vector<float> x(size_t(nevents)*fNodes1);
+	double sumw = 0;
+	for (long ievt=0; ievt<nevents; ievt++) {
+		for (int ivar=0; ivar<nvar; ivar++) x[ievt*fNodes1 + ivar] = Flatten(ivar, fInputs[ievt*nvar + ivar]);
+		x[ievt*fNodes1 + nvar] = 1;
+		sumw += std::max(fWeight[ievt], 0.f);
+	}
+
+	std::vector<double> hidden(fNodes2), g1(fW1.size()), g2(fW2.size());
+	const double rate = 0.5*fSpeed;
+	for (int iter=1; iter<=fNiter && sumw > 0; iter++) {
+		std::fill(g1.begin(), g1.end(), 0.);
+		std::fill(g2.begin(), g2.end(), 0.);
+		double loss = 0;
+		for (long ievt=0; ievt<nevents; ievt++) {
+			const double w = std::max(fWeight[ievt], 0.f)/sumw;
+			if (w == 0) continue;
+			const float* xi = &x[ievt*fNodes1];
+			// p = (Sigmoid(z)+1)/2 = 1/(1+exp(-z)), entropy gradient dL/dz = p - t
+			const double p = std::min(std::max(0.5*(Sigmoid(Forward(xi, &hidden[0])) + 1.), 1.e-7), 1. - 1.e-7);
+			const double t = fTarget[ievt] > 0.5 ? 1. : 0.;
+			loss -= w*(t > 0 ? std::log(p) : std::log(1. - p));
+			const double dz = w*(p - t);
+			for (int h=0; h<=nhidden; h++) g2[h] += dz*hidden[h];
+			for (int h=0; h<nhidden; h++) {
+				const double da = dz*fW2[h]*0.5*(1. - hidden[h]*hidden[h]);
+				double* g = &g1[h*fNodes1];
+				for (int i=0; i<fNodes1; i++) g[i] += da*xi[i];
+			}
+		}
+		for (size_t i=0; i<fW1.size(); i++) fW1[i] -= rate*g1[i];
+		for (size_t i=0; i<fW2.size(); i++) fW2[i] -= rate*g2[i];
+		printf("iteration %d  entropy %.6f\n", iter, loss);
+		fflush(stdout);
+	}
+	WriteExpertise();
+	fTrained = true;
+	fTrainTime = WallTime() - start;
+}
+
+bool NeuroBayesTeacher::SetInitialExpertise( const float* expertise, int size )
+{
+	// layout as written by WriteExpertise, without decorrelation
+	const int nvar = fNodes1 - 1;
+	const int nhidden = fNodes2 - 1;
+	const int expected = 6 + nvar*(3 + 2*kNknots) + nhidden*fNodes1 + fNodes2;
+	if (size != expected || int(expertise[0]) != fNodes1 || int(expertise[1]) != fNodes2 
+	    || int(expertise[4]) != kNknots || expertise[5] != 0) return false;
+	fKnotX.resize(size_t(nvar)*kNknots);
+	fKnotY.resize(size_t(nvar)*kNknots);
+	const float* p = expertise + 6;
+	for (int ivar=0; ivar<nvar; ivar++) {
+		p += 3;
+		std::copy(p, p + kNknots, fKnotX.begin() + ivar*kNknots);
+		std::copy(p + kNknots, p + 2*kNknots, fKnotY.begin() + ivar*kNknots);
+		p += 2*kNknots;
+	}
+	fW1.assign(p, p + nhidden*fNodes1);
+	fW2.assign(p + nhidden*fNodes1, p + nhidden*fNodes1 + fNodes2);
+	return true;
+}
+
+void NeuroBayesTeacher::WriteExpertise() const
+{
+	const int nvar = fNodes1 - 1;
+	const int nhidden = fNodes2 - 1;
+	FILE* out = fopen(fOutputFile.c_str(), "w");
+	if (!out) {
+		fprintf(stderr, "NeuroBayesTeacher stand-in: cannot write %s\n", fOutputFile.c_str());
+		return;
+	}
+	fprintf(out, "%d %d %d %d %d 0\n", fNodes1, fNodes2, 1, fPre, kNknots);
+	for (int ivar=0; ivar<nvar; ivar++) {
+		fprintf(out, "%d 0 0\n", fPreproFlags[ivar] >= 0 ? fPreproFlags[ivar] : fPre%100);
+		for (int k=0; k<kNknots; k++) fprintf(out, "%.9g ", fKnotX[ivar*kNknots + k]);
+		fprintf(out, "\n");
+		for (int k=0; k<kNknots; k++) fprintf(out, "%.9g ", fKnotY[ivar*kNknots + k]);
+		fprintf(out, "\n");
+	}
+	for (int h=0; h<nhidden; h++) {
+		for (int i=0; i<fNodes1; i++) fprintf(out, "%.9g ", fW1[h*fNodes1 + i]);
+		fprintf(out, "\n");
+	}
+	for (int h=0; h<fNodes2; h++) fprintf(out, "%.9g ", fW2[h]);
+	fprintf(out, "\n");
+	fclose(out);
+}
+
+void NeuroBayesTeacher::nb_correl_signi( char** varnames, const char* textFile, const char* htmlFile )
+{
+	const int nvar = fNodes1 - 1;
+	const long nevents = fTarget.size();
+	FILE* text = fopen(textFile, "w");
+	FILE* html = fopen(htmlFile, "w");
+	if (html) fprintf(html, "<html><body><table>\n<tr><th>variable</th><th>correlation to target</th></tr>\n");
+	for (int ivar=0; ivar<nvar; ivar++) {
+		double sw = 0, sx = 0, st = 0, sxx = 0, stt = 0, sxt = 0;
+		for (long ievt=0; ievt<nevents; ievt++) {
+			const double w = std::max(fWeight[ievt], 0.f), x = fInputs[ievt*nvar + ivar], t = fTarget[ievt];
+			sw += w; sx += w*x; st += w*t; sxx += w*x*x; stt += w*t*t; sxt += w*x*t;
+		}
+		double correlation = 0;
+		if (sw > 0) {
+			const double vx = sxx/sw - (sx/sw)*(sx/sw), vt = stt/sw - (st/sw)*(st/sw);
+			if (vx > 0 && vt > 0) correlation = (sxt/sw - (sx/sw)*(st/sw))/std::sqrt(vx*vt);
+		}
+		if (text) fprintf(text, "%d %s %.6f\n", ivar + 2, varnames[ivar], correlation);
+		if (html) fprintf(html, "<tr><td>%s</td><td>%.6f</td></tr>\n", varnames[ivar], correlation);
+	}
+	if (html) fprintf(html, "</table></body></html>\n");
+	if (text) fclose(text);
+	if (html) fclose(html);
+}
@@ -7,6 +7,7 @@
 
 
 #pragma link C++ class TMVA::MethodNeuroBayes+;
+#pragma link C++ class TMVA::NeuroBayesExpertGroup;
 #pragma link C++ namespace TMVA;
 #pragma link C++ nestedclass;
 #pragma link C++ nestedtypedef;
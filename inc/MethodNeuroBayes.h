@@ -16,12 +16,25 @@
 //#include "TMVA/MethodLikelihood.h"
 #endif
 
+#include <utility>
+#include <vector>
+
 #include "NeuroBayesTeacher.hh" //NeuroBayes Header
 #include "NeuroBayesExpert.hh"  //NeuroBayes Header
 
 
 namespace TMVA {
 
+	class NeuroBayesThreadPool;
+	class NeuroBayesNativeNet;
+	class NeuroBayesSample;
+	class NeuroBayesExpertise;
+	class NeuroBayesInputStatistics;
+	class NeuroBayesProfiler;
+	class NeuroBayesQuantizedNet;
+	class NeuroBayesDownsampler;
+	class NeuroBayesExpertLoader;
+
 	class MethodNeuroBayes : public MethodBase {
 
 	public: 
@@ -56,9 +69,22 @@ namespace TMVA {
 #else
 		virtual Double_t GetMvaValue( Double_t* errLower = 0);
 #endif
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,8,0)
+		// calculate the MVA values of a range of events in blocks
+		virtual std::vector<Double_t> GetMvaValues( Long64_t firstEvt = 0, Long64_t lastEvt = -1, Bool_t logProgress = false );
+#endif
+		// score nevents input rows of GetNvar() values each, stored contiguously.
+		// Uses NThreads scoring threads for large blocks.
+		void EvaluateBatch( const Double_t* inputs, Long64_t nevents, Double_t* values );
+		// with Profile: summary of the evaluation timings so far, to the
+		// log and to ProfileFile (also done when the method is deleted)
+		void PrintProfile();
 		virtual void Init();
 		virtual void AddWeightsXMLTo(void*) const;
 		virtual void ReadWeightsFromXML(void*);
+		// standalone C++ response class with the network compiled in
+		virtual void MakeClassSpecific( std::ostream& fout, const TString& className = "" ) const;
+		virtual void MakeClassSpecificHeader( std::ostream& fout, const TString& className = "" ) const;
 		virtual Bool_t HasAnalysisType(TMVA::Types::EAnalysisType, UInt_t, UInt_t);
 	      	//end virtual methods
 		// default initialisation method called by all constructors
@@ -67,16 +93,46 @@ namespace TMVA {
 		
 		static void RegisterNeuroBayes();
 
+		// entry points of the worker processes in IsolatedTraining and Scan mode
+		Int_t TrainInWorker();
+		Int_t TrainScanCandidate( UInt_t icand );
+		Int_t TrainFold( UInt_t ifold );
+
 
 	private:
 		int MyID; //Only NeuroBayes with myID=0 is trained
 		void InitEventSample( void );
+		void IngestTrainingEvents();
+		void FillSample( NeuroBayesSample& sample );
+		void LoadSample( NeuroBayesSample& sample );
+		// kFALSE if the input files cannot be identified
+		Bool_t GetInputCacheKey( ULong64_t& key );
+		static Bool_t GetFileIdentity( const TString& path, TString& identity );
+		void FeedTeacher( const NeuroBayesSample& sample, const std::vector<Char_t>* mask = 0 );
+		Bool_t ParseDownsampleFractions( Double_t fractions[2] ) const;
+		NeuroBayesDownsampler* CreateDownsampler( Long64_t nsignal, Long64_t nbackground ) const;
+		void FeedDownsampled( NeuroBayesDownsampler& downsampler );
+		void ReleaseTrainingEvents();
+		void ReloadTrainingEvents();
+		void LogMemory( const char* stage );
+		void ScoreExpertise( const TString& expertiseFile, const NeuroBayesSample& sample, 
+				     const std::vector<Long64_t>& events, std::vector<Double_t>& responses );
 		void SetMethodxxx();
 		std::vector<Event*>             fEventSample;     // the training events
       		std::vector<Event*>             fValidationSample;// the Validation events
 
 		NeuroBayesTeacher* nb;
 		Expert* Net;
+		TString fExpertiseFile;             // expertise file the Expert(s) were set up from
+		const NeuroBayesExpertise* fExpertise; //! expertise contents shared through NeuroBayesExpertiseCache
+		Bool_t fEmbedExpertise;
+		std::vector<Double_t> fInputBuffer; //! reusable input block for evaluation
+		static const Long64_t fgBatchSize;  // events gathered per block in GetMvaValues
+		static const Long64_t fgMinEventsPerThread; // smaller blocks are scored serially
+
+		NeuroBayesThreadPool* fThreadPool;  //! scoring threads, created on first use
+		std::vector<Expert*> fWorkerNets;   //! one Expert per additional scoring thread
+		const NeuroBayesNativeNet* fNative; //! shared in-plugin engine, set if InferenceBackend=Native passed its check
 		TString NBOutputFile;
 		Int_t fTask;
 		
@@ -97,12 +153,109 @@ namespace TMVA {
 		TString fNBIndiPreproFlagList;
 		TString fNBIndiPreproFlagVarname;
 		Bool_t frunAnalysis;
+		TString fMetricsFile;
+		TString fAnalysisMode;
+		Int_t fAnalysisJob; //! id of the background analysis report
+		TString fAnalysisCommand; //! its command, run in this process if it cannot be forked
+		Int_t fNThreads;
+		Int_t fIngestThreads;
+		Int_t fDownsampleEvents;
+		TString fDownsampleFraction;
+		Double_t fDownsampleSpeedup;        //! events seen / events trained on, 1 without downsampling
+		Bool_t fLowMemory;
+		TString fWarmStart;
+		Int_t fWarmStartIter;
+		Int_t fTrainingIter; //! iterations of this training, NtrainingIter or WarmStartIter
+		std::vector<Float_t> fWarmStartExpertise; //! checked WarmStart expertise, see LoadWarmStart
+		TString fWarmStartFile;             //! its expertise file
+		TString fSpillFile;                 //! training events moved out of the DataSet, "" if none
+		Bool_t fIsolatedTraining;
+		Int_t fTrainingWorkers;
+		Int_t fTrainingJob; //! id of this booking in the training process pool
+		TString fScan;
+		Int_t fScanSamples;
+		Float_t fScanHoldout;
+		std::vector<TString> fScanCandidates; //! "Name=value,..." settings per scan candidate
+		NeuroBayesSample* fSample;            //! training inputs kept in memory
+		NeuroBayesInputStatistics* fInputStats; //! statistics of the inputs passed to the Teacher
+		Int_t fKFolds;
+		std::vector<Expert*> fFoldNets;     //! Experts of folds 1..KFolds-1, Net is fold 0
+		std::vector<const NeuroBayesExpertise*> fFoldExpertises; //! their shared expertises
+		std::vector<TString> fFoldFiles;    //! their expertise files, known before they are loaded
+		Bool_t fFoldsTrainedHere;           //! the folds were trained on this job's training sample
+		std::vector< std::pair<const Event*, Long64_t> > fFoldEventIndex; //! its events sorted by address, built on first lookup
+		Long64_t fFoldEventHint;            //! index of the last event looked up
+		TString fInputCache;
+		Bool_t fEarlyStopping;
+		Float_t fValidationFraction;
+		Int_t fPatience;
+		Int_t fEarlyStoppingChunk;
+		TString fInferenceBackend;
+		Float_t fNativeTolerance;
+		TString fNativePrecision;
+		Float_t fQuantizationTolerance;
+		NeuroBayesQuantizedNet* fQuantized; //! reduced-precision copy of fNative, owned
+		Bool_t fProfile;
+		TString fProfileFile;
+		NeuroBayesProfiler* fProfiler;      //! evaluation timings, set with Profile or NEUROBAYES_PROFILE
+
+		TString fExpertLoading;
+		TString fExpertMode;                //! ExpertLoading in effect, see GetExpertLoading
+		enum { kExpertNone, kExpertDeferred, kExpertLoading, kExpertReady };
+		Int_t fExpertState;                 //! set up state of Net, one of the above
+		NeuroBayesExpertLoader* fExpertLoader; //! thread loading the Expert, owned
+		Double_t fExpertLoadTime;           //! s spent in LoadExpert
+		Long64_t fCreateExpertTime;         //! ns spent constructing Net in LoadExpert
+		const NeuroBayesNativeNet* fCheckedNet; //! native net of the last GetExportNet check
+		Bool_t fCheckedNetPassed;           //! its result
 
 		Bool_t TeacherConfigured;
 
 		TString* preproFlagsarray;
 
-		void runAnalysis();
+		void ConfigureTeacher();
+		// losses, if given, receives the loss of every iteration the
+		// Teacher printed one for
+		void TrainTeacher( Int_t firstIter = 0, Int_t niter = -1, std::vector<Double_t>* losses = 0 );
+		void LoadWarmStart();
+		void ApplyWarmStart();
+		void TrainWithEarlyStopping();
+		Double_t GetValidationLoss( const TString& expertiseFile );
+		void ClearValidationSample();
+		void ResetInputStatistics();
+		void TrainIsolated();
+		void TrainInProcess();
+		Bool_t InitWorker( const TString& suffix );
+		void TrainScan();
+		void TrainKFolds();
+		void LoadFolds();
+		void ClearFolds();
+		Long64_t GetFoldEvent();
+		void EvaluateFolds( const Double_t* inputs, Long64_t nevents, const Long64_t* events, Double_t* values );
+		void BuildScanCandidates();
+		void ApplyScanCandidate( const TString& settings );
+		Bool_t ApplyScanSetting( const TString& name, const TString& value );
+		void SetupExpert( const TString& expertiseFile, const NeuroBayesExpertise* expertise = 0,
+				  const std::vector<TString>& foldFiles = std::vector<TString>() );
+		void ClearExpert();
+		TString GetExpertLoading();
+		void LoadExpert();
+		void WaitForExpert();
+		friend class NeuroBayesExpertLoader;
+		// ns receives the construction time
+		Expert* CreateExpert( Long64_t& ns );
+		void InitProfiler();
+		void SetupThreadPool();
+		void ClearThreadPool();
+		void SetupNativeNet();
+		Bool_t CheckNativeNet( const NeuroBayesNativeNet& net );
+		// NULL with the reason if MakeClass cannot export the network
+		const NeuroBayesNativeNet* GetExportNet( TString& problem );
+		void SetupQuantizedNet();
+		void FillCheckInputs( std::vector<Double_t>& inputs );
+
+		void runAnalysis( Bool_t async = kFALSE );
+		void WaitForAnalysis();
 		void dumpPseudoCodegen();
 		void ParseIndiviPreproFlagFromList();
 		void ParseIndiviPreproFlagByVarname();
@@ -0,0 +1,68 @@
+/****************************************************************
+ * Stratified reservoir sample of the NeuroBayes training inputs,
+ * selected with the Downsample options of MethodNeuroBayes.
+ *
+ * Events stream through Add once; every class (target 1 signal,
+ * 0 background) keeps a uniform random subset of at most its quota
+ * (Vitter's algorithm R, fixed seed, so a training is reproducible).
+ * After Finish the weights of the kept events of a class are scaled
+ * by sum of weights seen / sum of weights kept, so every class
+ * enters the Teacher with its original normalisation.
+ *
+ * Internal helper, not part of the ROOT dictionary.
+ * *************************************************************/
+
+#ifndef ROOT_TMVA_NeuroBayesDownsampler
+#define ROOT_TMVA_NeuroBayesDownsampler
+
+#include <vector>
+#include "Rtypes.h"
+
+namespace TMVA {
+
+	class NeuroBayesDownsampler {
+
+	public:
+		enum { kBackground = 0, kSignal = 1, kNClasses = 2 };
+
+		NeuroBayesDownsampler( UInt_t nvar, Long64_t signalQuota, Long64_t backgroundQuota, ULong64_t seed = 4711 );
+
+		void Add( const Float_t* inputs, Float_t target, Float_t weight );
+		// rescales the kept weights, no Add afterwards
+		void Finish();
+
+		UInt_t   GetNvar() const                  { return fNvar; }
+		Long64_t GetNSeen( UInt_t iclass ) const  { return fClasses[iclass].seen; }
+		Long64_t GetNKept( UInt_t iclass ) const  { return fClasses[iclass].weights.size(); }
+		Double_t GetSumOfWeightsSeen( UInt_t iclass ) const { return fClasses[iclass].sumSeen; }
+		Double_t GetScale( UInt_t iclass ) const  { return fClasses[iclass].scale; }
+
+		// kept event i of a class, weight rescaled after Finish
+		const Float_t* GetInputs( UInt_t iclass, Long64_t i ) const { return &fClasses[iclass].inputs[i*fNvar]; }
+		Float_t GetWeight( UInt_t iclass, Long64_t i ) const { return fClasses[iclass].weights[i]*fClasses[iclass].scale; }
+
+		// quotas splitting target events evenly over the classes, a class
+		// with fewer events keeps all and leaves the rest to the other
+		static void SplitTarget( Long64_t target, Long64_t nsignal, Long64_t nbackground,
+					 Long64_t& signalQuota, Long64_t& backgroundQuota );
+
+	private:
+		struct Reservoir {
+			Long64_t quota;
+			Long64_t seen;
+			Double_t sumSeen;
+			Double_t scale;
+			std::vector<Float_t> inputs;  // [kept][nvar]
+			std::vector<Float_t> weights; // as given
+		};
+
+		// uniform in [0, n)
+		Long64_t Random( Long64_t n );
+
+		UInt_t    fNvar;
+		ULong64_t fState;
+		Reservoir fClasses[kNClasses];
+	};
+}
+
+#endif
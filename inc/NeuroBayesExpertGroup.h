@@ -0,0 +1,112 @@
+/****************************************************************
+ * Evaluates several NeuroBayes expertises on the same events, in
+ * place of one TMVA::Reader method per network.
+ *
+ * Every network is added with the names of its input variables, or
+ * from its TMVA weight file. The group keeps one merged list of all
+ * variables: the inputs of an event are filled once (SetValue or
+ * GetInputs) and every network takes its columns from there. Blocks
+ * of events are scored network by network, so the weights of one
+ * network stay in cache for the whole block. Like the Native backend
+ * of MethodNeuroBayes, a network runs on the in-plugin engine
+ * (NeuroBayesNativeNet) only if that reads its expertise and
+ * reproduces nb_expert within the tolerance on pseudo-random inputs
+ * spread over the preprocessing range; otherwise on a NeuroBayes
+ * Expert. Responses are those of MethodNeuroBayes::GetMvaValue, in
+ * [-1,1].
+ *
+ *   TMVA::NeuroBayesExpertGroup group;
+ *   group.AddWeightFile("weights/job_NeuroBayesA.weights.xml");
+ *   group.AddWeightFile("weights/job_NeuroBayesB.weights.xml");
+ *   Int_t ipt = group.GetVariableIndex("pt");
+ *   ... per event:
+ *   group.SetValue(ipt, pt); ...
+ *   const std::vector<Double_t>& responses = group.Evaluate();
+ *
+ * Not thread-safe, use one group per thread like a Reader.
+ * *************************************************************/
+
+#ifndef ROOT_TMVA_NeuroBayesExpertGroup
+#define ROOT_TMVA_NeuroBayesExpertGroup
+
+#include <vector>
+#include "Rtypes.h"
+#include "TString.h"
+
+class Expert;
+
+namespace TMVA {
+
+	class MsgLogger;
+	class NeuroBayesNativeNet;
+	class NeuroBayesExpertise;
+
+	class NeuroBayesExpertGroup {
+
+	public:
+		// native: try the in-plugin engine, tolerance: its maximum accepted
+		// deviation from nb_expert (the NativeTolerance of the method)
+		NeuroBayesExpertGroup( Bool_t native = kTRUE, Double_t tolerance = 1.e-4 );
+		~NeuroBayesExpertGroup();
+
+		// index of the new network, -1 if the expertise cannot be read.
+		// variables are the expressions of its inputs in training order.
+		Int_t AddExpert( const TString& expertiseFile, const std::vector<TString>& variables, const TString& name = "" );
+		// from the weight XML of a trained MethodNeuroBayes, using the
+		// embedded expertise if there is one; methods with variable
+		// transformations or KFolds are not supported
+		Int_t AddWeightFile( const TString& weightFile, const TString& name = "" );
+
+		UInt_t GetNExperts() const   { return fNets.size(); }
+		UInt_t GetNVariables() const { return fVariables.size(); }
+		const TString& GetExpertName( UInt_t iexpert ) const { return fNets[iexpert].name; }
+		const TString& GetVariable( UInt_t ivar ) const     { return fVariables[ivar]; }
+		// index in the merged variable list, -1 if no network uses it
+		Int_t GetVariableIndex( const TString& variable ) const;
+		Bool_t IsNative( UInt_t iexpert ) const { return fNets[iexpert].native != 0; }
+
+		// inputs of one event in the merged variable order
+		void SetValue( UInt_t ivar, Double_t value ) { fInputs[ivar] = value; }
+		Double_t* GetInputs() { return fInputs.empty() ? 0 : &fInputs[0]; }
+		// responses of all networks to the event in GetInputs
+		const std::vector<Double_t>& Evaluate();
+
+		// nevents rows of GetNVariables() inputs each; responses
+		// [nevents][GetNExperts()]
+		void EvaluateBatch( const Double_t* inputs, Long64_t nevents, Double_t* responses );
+
+	private:
+		struct Net {
+			TString name;
+			TString expertiseFile;
+			const NeuroBayesExpertise* expertise;
+			const NeuroBayesNativeNet* native; // shared through the expertise cache
+			Expert* expert;                    // owned, if not native
+			std::vector<UInt_t> columns;       // merged variable index of every input
+		};
+
+		// takes over the reference to expertise
+		Int_t AddNet( const TString& name, const TString& expertiseFile, const NeuroBayesExpertise* expertise,
+			      const std::vector<TString>& variables );
+		// the native engine reproduces expert on check inputs
+		Bool_t CheckNative( const NeuroBayesNativeNet& native, Expert& expert, Double_t& maxdev );
+		UInt_t AddVariable( const TString& variable );
+		MsgLogger& Log() const { return *fLogger; }
+
+		Bool_t fUseNative;
+		Double_t fTolerance;
+		std::vector<Net> fNets;
+		std::vector<TString> fVariables;
+		std::vector<Double_t> fInputs;    // one event, merged order
+		std::vector<Double_t> fResponses; // one event, per network
+		std::vector<Double_t> fGathered;  // scratch: block of one network's inputs
+		std::vector<Float_t>  fRow;       // scratch: one row for an Expert
+		std::vector<Double_t> fValues;    // scratch: block of one network's responses
+		MsgLogger* fLogger;
+
+		NeuroBayesExpertGroup( const NeuroBayesExpertGroup& );
+		NeuroBayesExpertGroup& operator=( const NeuroBayesExpertGroup& );
+	};
+}
+
+#endif
@@ -0,0 +1,86 @@
+/****************************************************************
+ * Process-wide cache of parsed expertises. Every MethodNeuroBayes
+ * set up from the same expertise (e.g. one TMVA::Reader per thread)
+ * shares one immutable copy of the expertise contents and of the
+ * native network; only the Expert with its per-call state is kept
+ * per instance.
+ *
+ * Files are keyed by canonical path and modification time, so a
+ * retrained expertise is never mistaken for the old one. Entries are
+ * reference counted and dropped with their last user. Thread-safe.
+ *
+ * NewExpert is the one place the plugin constructs a NeuroBayes
+ * Expert. The Expert is not known to be safe to construct
+ * concurrently, so all constructions in the process, from any thread
+ * or method, run one at a time.
+ *
+ * Internal helper, not part of the ROOT dictionary.
+ * *************************************************************/
+
+#ifndef ROOT_TMVA_NeuroBayesExpertiseCache
+#define ROOT_TMVA_NeuroBayesExpertiseCache
+
+#include <map>
+#include <vector>
+#include "Rtypes.h"
+#include "TString.h"
+
+class Expert;
+
+namespace TMVA {
+
+	class NeuroBayesNativeNet;
+
+	// immutable contents of one expertise, owned by the cache
+	class NeuroBayesExpertise {
+	public:
+		const TString& GetKey() const               { return fKey; }
+		const std::vector<Float_t>& GetData() const { return fData; }
+
+	private:
+		friend class NeuroBayesExpertiseCache;
+		NeuroBayesExpertise( const TString& key ) : fKey(key), fNative(0), fNativeRead(kFALSE), fRefs(1) {}
+		~NeuroBayesExpertise();
+
+		TString fKey;
+		std::vector<Float_t> fData;
+		NeuroBayesNativeNet* fNative; // parsed on first request
+		Bool_t fNativeRead;
+		UInt_t fRefs;
+	};
+
+	class NeuroBayesExpertiseCache {
+
+	public:
+		// expertise of a file, NULL if it cannot be read
+		static const NeuroBayesExpertise* Acquire( const char* filename );
+		// contents not read from a file (embedded in the weights) are
+		// cached under a key chosen by the caller. Find returns NULL if the
+		// key is unknown; Insert takes the contents (data is left empty)
+		// unless another thread was first.
+		static const NeuroBayesExpertise* Find( const TString& key );
+		static const NeuroBayesExpertise* Insert( const TString& key, std::vector<Float_t>& data );
+		// the ExpertiseData node of a MethodNeuroBayes weight file, keyed by
+		// a hash of its content; NULL if it cannot be decoded
+		static const NeuroBayesExpertise* AcquireEmbedded( const char* content, const TString& encoding, Int_t size );
+
+		// every Acquire, Find and Insert result has to be released once
+		static void Release( const NeuroBayesExpertise* entry );
+
+		// native network of an expertise, NULL if it does not follow the layout
+		static const NeuroBayesNativeNet* GetNativeNet( const NeuroBayesExpertise* entry );
+
+		// new Expert of the expertise contents, or of filename if entry is
+		// NULL; owned by the caller
+		static Expert* NewExpert( const NeuroBayesExpertise* entry, const char* filename );
+
+		static UInt_t GetNEntries();
+
+	private:
+		typedef std::map<TString, NeuroBayesExpertise*> EntryMap;
+		static EntryMap& Entries();
+		static TString FileKey( const char* filename );
+	};
+}
+
+#endif
@@ -0,0 +1,67 @@
+/****************************************************************
+ * Weighted means, variances and co-moments of the training inputs
+ * and the target, accumulated event by event while the inputs are
+ * passed to the Teacher (West's weighted Welford update in double
+ * precision). Gives the input correlation matrix, the correlations
+ * with the target and, per variable, the part of the total
+ * correlation to the target that is lost when the variable is
+ * removed (least important first), which MethodNeuroBayes uses for
+ * its variable ranking.
+ *
+ * Events with non-positive weight are not counted.
+ *
+ * Internal helper, not part of the ROOT dictionary.
+ * *************************************************************/
+
+#ifndef ROOT_TMVA_NeuroBayesInputStatistics
+#define ROOT_TMVA_NeuroBayesInputStatistics
+
+#include <vector>
+#include "Rtypes.h"
+
+namespace TMVA {
+
+	class NeuroBayesInputStatistics {
+
+	public:
+		NeuroBayesInputStatistics( UInt_t nvar = 0 );
+
+		void Reset( UInt_t nvar );
+		void Fill( const Float_t* inputs, Float_t target, Float_t weight );
+
+		UInt_t   GetNvar() const          { return fNvar; }
+		Long64_t GetNEvents() const       { return fNevents; }
+		Double_t GetSumOfWeights() const  { return fSumW; }
+		Double_t GetEffectiveEvents() const { return fSumW2 > 0 ? fSumW*fSumW/fSumW2 : 0; }
+
+		// ivar = GetNvar() is the target
+		Double_t GetMean( UInt_t ivar ) const     { return fMean[ivar]; }
+		Double_t GetVariance( UInt_t ivar ) const { return fSumW > 0 ? GetComoment(ivar, ivar)/fSumW : 0; }
+		Double_t GetCorrelation( UInt_t ivar, UInt_t jvar ) const;
+		Double_t GetTargetCorrelation( UInt_t ivar ) const { return GetCorrelation(ivar, fNvar); }
+
+		// squared total correlation of all inputs to the target, and per
+		// variable the loss of it when the variable is removed, removing
+		// the least important remaining variable at every step
+		Bool_t GetCorrelationLoss( Double_t& total, std::vector<Double_t>& loss ) const;
+
+		// text file, e.g. to pass the statistics out of a worker process
+		Bool_t Write( const char* filename ) const;
+		Bool_t Read( const char* filename );
+
+	private:
+		Double_t GetComoment( UInt_t i, UInt_t j ) const { return i <= j ? fComoment[i*fDim + j] : fComoment[j*fDim + i]; }
+
+		UInt_t   fNvar;
+		UInt_t   fDim;      // nvar + target
+		Long64_t fNevents;
+		Double_t fSumW;
+		Double_t fSumW2;
+		std::vector<Double_t> fMean;     // [fDim]
+		std::vector<Double_t> fComoment; // [fDim][fDim], upper triangle filled
+		std::vector<Double_t> fDeltaOld; // scratch: x - mean before the update
+		std::vector<Double_t> fDeltaNew; // scratch: x - mean after the update
+	};
+}
+
+#endif
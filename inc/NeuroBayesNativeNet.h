@@ -0,0 +1,94 @@
+/****************************************************************
+ * In-plugin inference engine for NeuroBayes expertises.
+ *
+ * Parses an expertise in the layout assumed in NeuroBayesNativeNet.cxx
+ * and evaluates preprocessing and the three-layer network with float32
+ * weights. The layout is not documented by NeuroBayes, so users of the
+ * engine compare it with nb_expert before relying on it. It is the one
+ * written by the stand-in in bench/standin and has not been validated
+ * against expertises of a real NeuroBayes Teacher, which are expected to
+ * fail that comparison; the engine is experimental. The dense layers
+ * run on AVX-512, AVX2/FMA or plain C++ kernels, chosen at run time
+ * from what the CPU supports.
+ *
+ * Internal helper, not part of the ROOT dictionary.
+ * *************************************************************/
+
+#ifndef ROOT_TMVA_NeuroBayesNativeNet
+#define ROOT_TMVA_NeuroBayesNativeNet
+
+#include <istream>
+#include <vector>
+#include "Rtypes.h"
+
+namespace TMVA {
+
+	class NeuroBayesNativeNet {
+
+	public:
+		NeuroBayesNativeNet();
+
+		// read the float array of an expertise file or of its contents
+		static Bool_t ReadExpertiseFile( const char* filename, std::vector<Float_t>& expertise );
+		static Bool_t ReadExpertiseStream( std::istream& in, std::vector<Float_t>& expertise );
+
+		// set up the network from an expertise; kFALSE if the contents
+		// do not follow the expected layout
+		Bool_t ReadExpertise( const char* filename );
+		Bool_t SetExpertise( const std::vector<Float_t>& expertise );
+
+		UInt_t GetNvar() const         { return fNvar; }
+		UInt_t GetNhidden() const      { return fNhidden; }
+		Int_t  GetPreprocessing() const { return fPreprocessing; }
+		Int_t  GetPreproFlag( UInt_t ivar ) const { return fPreproFlags[ivar]; }
+		const char* GetKernelName() const;
+
+		// parsed network, e.g. for code generation
+		UInt_t  GetNknots() const                    { return fNknots; }
+		Bool_t  HasMissing( UInt_t ivar ) const      { return fHasMissing[ivar]; }
+		Float_t GetMissingValue( UInt_t ivar ) const { return fMissingValue[ivar]; }
+		const Float_t* GetKnotX( UInt_t ivar ) const { return &fKnotX[ivar*fNknots]; }
+		const Float_t* GetKnotY( UInt_t ivar ) const { return &fKnotY[ivar*fNknots]; }
+		Bool_t  IsDecorrelated() const               { return fDecorrelate; }
+		Float_t GetDecorrelation( UInt_t i, UInt_t j ) const { return fDecorr[i*fInputStride + j]; }
+		// input ivar (fNvar = bias) to hidden node h, hidden node h (fNhidden = bias) to output
+		Float_t GetWeight1( UInt_t h, UInt_t ivar ) const { return fW1T[ivar*fHiddenStride + h]; }
+		Float_t GetWeight2( UInt_t h ) const               { return fW2[h]; }
+
+		// score nevents rows of GetNvar() inputs each. Reentrant: all
+		// scratch space is local to the call, so several threads may
+		// share one instance.
+		void Evaluate( const Double_t* inputs, Long64_t nevents, Double_t* values ) const;
+
+	private:
+		typedef void    (*AxpyKernel)( Float_t a, const Float_t* w, Float_t* acc, UInt_t n );
+		typedef Float_t (*DotKernel)( const Float_t* a, const Float_t* b, UInt_t n );
+
+		void SelectKernels();
+		void Preprocess( const Double_t* input, Float_t* x, Float_t* scratch ) const;
+		static Float_t Sigmoid( Float_t x );
+
+		UInt_t fNvar;
+		UInt_t fNhidden;      // hidden nodes without the bias node
+		UInt_t fNknots;       // knots per preprocessing table
+		UInt_t fInputStride;  // nvar + bias node, padded for the kernels
+		UInt_t fHiddenStride; // nhidden + bias node, padded for the kernels
+		Int_t  fPreprocessing;
+		Bool_t fDecorrelate;
+
+		std::vector<Int_t>   fPreproFlags;
+		std::vector<Bool_t>  fHasMissing;
+		std::vector<Float_t> fMissingValue;
+		std::vector<Float_t> fKnotX;   // [nvar][nknots]
+		std::vector<Float_t> fKnotY;   // [nvar][nknots]
+		std::vector<Float_t> fDecorr;  // [nvar][fInputStride]
+		std::vector<Float_t> fW1T;     // input->hidden, transposed: [nvar+1][fHiddenStride]
+		std::vector<Float_t> fW2;      // hidden->output: [fHiddenStride]
+
+		AxpyKernel fAxpy;
+		DotKernel  fDot;
+		const char* fKernelName;
+	};
+}
+
+#endif
@@ -0,0 +1,79 @@
+/****************************************************************
+ * Runs jobs in forked worker processes, at most a given number
+ * at a time. Used by MethodNeuroBayes to train several Teachers
+ * concurrently: the Teacher is a singleton, so every training
+ * needs a process of its own.
+ *
+ * Internal helper, not part of the ROOT dictionary.
+ * *************************************************************/
+
+#ifndef ROOT_TMVA_NeuroBayesProcessPool
+#define ROOT_TMVA_NeuroBayesProcessPool
+
+#include <sys/types.h>
+#include <vector>
+#include "Rtypes.h"
+
+namespace TMVA {
+
+	class NeuroBayesProcessPool {
+
+	public:
+		class Job {
+		public:
+			virtual ~Job() {}
+			// executed in the worker process, the result is its exit status
+			virtual Int_t Run() = 0;
+		};
+
+		// maxWorkers = 0 uses the number of online cores
+		NeuroBayesProcessPool( UInt_t maxWorkers = 0 );
+		~NeuroBayesProcessPool();
+
+		void   SetMaxWorkers( UInt_t maxWorkers );
+		UInt_t GetMaxWorkers() const { return fMaxWorkers; }
+
+		// queue a job, the pool takes ownership; returns its id
+		Int_t Submit( Job* job );
+		// drop a job that has not been started yet
+		void  Cancel( Int_t id );
+		// fork pending jobs until the worker limit is reached
+		void  StartPending();
+		// block until job id has finished, keep the pool busy meanwhile.
+		// Returns the exit status, or -1 if the worker did not exit normally
+		// or could not be forked.
+		Int_t Wait( Int_t id );
+		void  WaitAll();
+		// collect the workers that have finished without blocking, so their
+		// wall time ends when they did rather than at the next Wait
+		void  Poll();
+		// the job never ran because fork failed
+		Bool_t ForkFailed( Int_t id ) const { return fEntries[id].state == kForkFailed; }
+
+		Double_t GetWallTime( Int_t id ) const;
+
+	private:
+		enum EState { kPending, kRunning, kDone, kCancelled, kForkFailed };
+		struct Entry {
+			Job*     job;
+			pid_t    pid;
+			EState   state;
+			Int_t    status;
+			Double_t start;
+			Double_t stop;
+		};
+
+		void Start( Entry& entry );
+		Bool_t Reap(); // collect finished workers, kTRUE if any
+		static Double_t Now();
+
+		std::vector<Entry> fEntries;
+		UInt_t fMaxWorkers;
+		UInt_t fRunning;
+
+		NeuroBayesProcessPool( const NeuroBayesProcessPool& );
+		NeuroBayesProcessPool& operator=( const NeuroBayesProcessPool& );
+	};
+}
+
+#endif
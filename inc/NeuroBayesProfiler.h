@@ -0,0 +1,109 @@
+/****************************************************************
+ * Latency histograms of the evaluation hot path of MethodNeuroBayes,
+ * switched on with the Profile option or NEUROBAYES_PROFILE=1.
+ *
+ * Every scoring slot (0 is the calling thread, 1.. the threads of the
+ * NeuroBayesThreadPool) fills its own set of histograms, so recording
+ * needs neither locks nor atomics. Other threads, like the one loading
+ * the Expert in the background, only take times and leave the filling
+ * to the calling thread. Bins are logarithmic with four
+ * bins per power of two of nanoseconds (resolution about 20%), mean
+ * and maximum are exact. Summaries merge all slots.
+ *
+ * Internal helper, not part of the ROOT dictionary.
+ * *************************************************************/
+
+#ifndef ROOT_TMVA_NeuroBayesProfiler
+#define ROOT_TMVA_NeuroBayesProfiler
+
+#include <ctime>
+#include <string>
+#include <vector>
+#include "Rtypes.h"
+
+namespace TMVA {
+
+	class NeuroBayesProfiler {
+
+	public:
+		enum EChannel {
+			kGetMvaValue,  // per call, gathering and scoring
+			kGather,       // per event, copying the inputs out of the Event
+			kExpert,       // per event, nb_expert or the native engine
+			kBatch,        // per EvaluateBatch call
+			kReadWeights,  // per ReadWeightsFromXML call
+			kCreateExpert, // per Expert constructed
+			kNChannels
+		};
+
+		struct Summary {
+			Long64_t calls;
+			Long64_t entries;  // events for the per-event channels
+			Double_t total;    // ns
+			Double_t mean, p50, p90, p99, max; // ns
+		};
+
+		NeuroBayesProfiler( UInt_t nslots = 1 );
+		~NeuroBayesProfiler();
+
+		// not while another thread is recording
+		void   SetNSlots( UInt_t nslots );
+		UInt_t GetNSlots() const { return fSlots.size(); }
+		void   Reset();
+
+		static Long64_t Now() {
+			struct timespec ts;
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			return Long64_t(ts.tv_sec)*1000000000LL + ts.tv_nsec;
+		}
+
+		// one call of n entries taking ns nanoseconds each
+		void Fill( UInt_t islot, EChannel channel, Long64_t ns, Long64_t n = 1 ) {
+			Histogram& h = fSlots[islot]->fChannels[channel];
+			if (ns < 0) ns = 0;
+			h.fCounts[Bin(ns)] += n;
+			h.fCalls++;
+			h.fEntries += n;
+			h.fTotal += Double_t(ns)*n;
+			if (ns > h.fMax) h.fMax = ns;
+		}
+
+		Summary  GetSummary( EChannel channel ) const;
+		Long64_t GetEntries( UInt_t islot, EChannel channel ) const { return fSlots[islot]->fChannels[channel].fEntries; }
+		static const char* GetChannelName( EChannel channel );
+
+		// summary table in us, one line per channel that was filled
+		std::vector<std::string> Format() const;
+		Bool_t Write( const char* filename, const char* title ) const;
+
+	private:
+		enum { kSubBins = 4, kNBins = 256 };
+
+		struct Histogram {
+			Long64_t fCounts[kNBins];
+			Long64_t fCalls;
+			Long64_t fEntries;
+			Double_t fTotal;
+			Long64_t fMax;
+		};
+		struct Slot {
+			Histogram fChannels[kNChannels];
+			char fPad[64]; // keeps neighbouring slots off each other's cache lines
+		};
+
+		// bin 4*(e-1)+s holds [(4+s)<<(e-2), (5+s)<<(e-2)) with e = floor(log2 ns)
+		static UInt_t Bin( Long64_t ns ) {
+			if (ns < kSubBins) return UInt_t(ns);
+			const UInt_t e = 63 - __builtin_clzll(ULong64_t(ns));
+			return kSubBins*(e - 1) + UInt_t((ns >> (e - 2)) & (kSubBins - 1));
+		}
+		static Double_t BinCenter( UInt_t bin );
+
+		std::vector<Slot*> fSlots;
+
+		NeuroBayesProfiler( const NeuroBayesProfiler& );
+		NeuroBayesProfiler& operator=( const NeuroBayesProfiler& );
+	};
+}
+
+#endif
@@ -0,0 +1,80 @@
+/****************************************************************
+ * Reduced-precision copy of a NeuroBayesNativeNet for the
+ * application phase, selected with NativePrecision=Half or Int8.
+ *
+ * The input->hidden weights, which dominate the memory traffic, are
+ * stored as IEEE float16 (Half) or as int8 with one scale per hidden
+ * node (Int8); in Int8 mode the preprocessed inputs of every event
+ * are quantized to int8 with one scale per event as well, so the
+ * hidden layer is an integer dot product. The preprocessing tables
+ * keep their knots in float (they bin the raw inputs) and pack the
+ * table values as int16 with one scale per variable. Decorrelation
+ * and the hidden->output layer stay float. The kernels use AVX2
+ * (F16C for Half) when the CPU has it, plain C++ otherwise.
+ *
+ * Internal helper, not part of the ROOT dictionary.
+ * *************************************************************/
+
+#ifndef ROOT_TMVA_NeuroBayesQuantizedNet
+#define ROOT_TMVA_NeuroBayesQuantizedNet
+
+#include <vector>
+#include "Rtypes.h"
+
+namespace TMVA {
+
+	class NeuroBayesNativeNet;
+
+	class NeuroBayesQuantizedNet {
+
+	public:
+		enum EPrecision { kHalf, kInt8 };
+
+		NeuroBayesQuantizedNet( const NeuroBayesNativeNet& net, EPrecision precision );
+
+		EPrecision  GetPrecision() const { return fPrecision; }
+		UInt_t      GetNvar() const      { return fNvar; }
+		const char* GetKernelName() const { return fKernelName; }
+		// bytes of tables and weights, of this and of the float network
+		size_t GetSize() const;
+		static size_t GetSize( const NeuroBayesNativeNet& net );
+
+		// as NeuroBayesNativeNet::Evaluate, reentrant
+		void Evaluate( const Double_t* inputs, Long64_t nevents, Double_t* values ) const;
+
+		// IEEE 754 binary16 conversion, round to nearest even
+		static UShort_t FloatToHalf( Float_t value );
+		static Float_t  HalfToFloat( UShort_t half );
+
+	private:
+		typedef Float_t (*HalfDotKernel)( const UShort_t* w, const Float_t* x, UInt_t n );
+		typedef Int_t   (*Int8DotKernel)( const signed char* w, const signed char* x, UInt_t n );
+
+		void Preprocess( const Double_t* input, Float_t* x, Float_t* scratch ) const;
+
+		EPrecision fPrecision;
+		UInt_t fNvar;
+		UInt_t fNhidden;
+		UInt_t fNknots;
+		UInt_t fInputStride;   // nvar + bias node, padded for the kernels
+		Bool_t fDecorrelate;
+
+		std::vector<Char_t>  fHasMissing;
+		std::vector<Float_t> fMissingValue;
+		std::vector<Float_t> fKnotX;       // [nvar][nknots]
+		std::vector<Short_t> fKnotY;       // [nvar][nknots], times fKnotYScale
+		std::vector<Float_t> fKnotYScale;  // [nvar]
+		std::vector<Float_t> fDecorr;      // [nvar][nvar]
+
+		std::vector<UShort_t> fW1Half;     // Half: [nhidden][fInputStride]
+		std::vector<signed char> fW1Int8; // Int8: [nhidden][fInputStride], times fW1Scale
+		std::vector<Float_t>  fW1Scale;    // Int8: [nhidden]
+		std::vector<Float_t>  fW2;         // [nhidden+1]
+
+		HalfDotKernel fHalfDot;
+		Int8DotKernel fInt8Dot;
+		const char* fKernelName;
+	};
+}
+
+#endif
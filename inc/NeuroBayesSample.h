@@ -0,0 +1,74 @@
+/****************************************************************
+ * Training inputs of MethodNeuroBayes extracted once from the TMVA
+ * event loop: one float row per event plus target and weight, in
+ * the form the Teacher takes them. Used to train several Teachers
+ * (scans, folds) without repeating the event loop, and to score
+ * held-out events.
+ *
+ * A sample can be written to a binary cache file and memory-mapped
+ * back, so retraining on the same inputs skips the event loop.
+ *
+ * Internal helper, not part of the ROOT dictionary.
+ * *************************************************************/
+
+#ifndef ROOT_TMVA_NeuroBayesSample
+#define ROOT_TMVA_NeuroBayesSample
+
+#include <cstddef>
+#include <vector>
+#include "Rtypes.h"
+
+namespace TMVA {
+
+	class NeuroBayesSample {
+
+	public:
+		NeuroBayesSample( UInt_t nvar = 0 );
+		~NeuroBayesSample();
+
+		void Reserve( Long64_t nevents );
+		void AddEvent( const Float_t* inputs, Float_t target, Float_t weight );
+
+		UInt_t   GetNvar() const    { return fNvar; }
+		Long64_t GetNEvents() const { return fNevents; }
+		const Float_t* GetInputs( Long64_t ievt ) const { return fInputsData + ievt*fNvar; }
+		Float_t  GetTarget( Long64_t ievt ) const { return fTargetsData[ievt]; }
+		Float_t  GetWeight( Long64_t ievt ) const { return fWeightsData[ievt]; }
+
+		// cache file: header, inputs [nevents][nvar], targets, weights.
+		// MapCache only accepts a file written with the same key.
+		Bool_t WriteCache( const char* filename, ULong64_t key ) const;
+		Bool_t MapCache( const char* filename, ULong64_t key );
+		Bool_t IsMapped() const { return fMapping != 0; }
+
+		// FNV-1a, to build cache keys
+		static ULong64_t Hash( const void* data, size_t length, ULong64_t hash = 14695981039346656037ULL );
+
+		// evenly spread selection of a fraction of the events
+		static Bool_t InFraction( Long64_t ievt, Double_t fraction );
+
+		// quality of responses in [-1,1] (as from nb_expert) on the listed
+		// events: weighted area under the ROC curve and mean cross entropy
+		Double_t GetROCIntegral( const std::vector<Long64_t>& events, const std::vector<Double_t>& responses ) const;
+		Double_t GetEntropyLoss( const std::vector<Long64_t>& events, const std::vector<Double_t>& responses ) const;
+
+	private:
+		void Unmap();
+
+		UInt_t   fNvar;
+		Long64_t fNevents;
+		std::vector<Float_t> fInputs;  // [nevents][nvar], unless mapped
+		std::vector<Float_t> fTargets; // 1 signal, 0 background
+		std::vector<Float_t> fWeights;
+		const Float_t* fInputsData;    // point into the vectors or the mapping
+		const Float_t* fTargetsData;
+		const Float_t* fWeightsData;
+		void*  fMapping;
+		size_t fMappingSize;
+
+		NeuroBayesSample( const NeuroBayesSample& );
+		NeuroBayesSample& operator=( const NeuroBayesSample& );
+	};
+}
+
+#endif
@@ -0,0 +1,55 @@
+/****************************************************************
+ * Small persistent pthread pool used by MethodNeuroBayes to score
+ * blocks of events on several cores. Every Run() hands the same
+ * task to all slots; slot 0 runs on the calling thread. Each task
+ * decides from its slot index which part of the work it owns, so
+ * results land in deterministic positions.
+ *
+ * Internal helper, not part of the ROOT dictionary.
+ * *************************************************************/
+
+#ifndef ROOT_TMVA_NeuroBayesThreadPool
+#define ROOT_TMVA_NeuroBayesThreadPool
+
+#include <pthread.h>
+#include <vector>
+#include "Rtypes.h"
+
+namespace TMVA {
+
+	class NeuroBayesThreadPool {
+
+	public:
+		class Task {
+		public:
+			virtual ~Task() {}
+			virtual void Run( UInt_t islot, UInt_t nslots ) = 0;
+		};
+
+		NeuroBayesThreadPool( UInt_t nthreads );
+		~NeuroBayesThreadPool();
+
+		UInt_t GetNThreads() const { return fWorkers.size() + 1; }
+
+		// run task on all slots and return once every slot has finished
+		void Run( Task* task );
+
+	private:
+		static void* WorkerLoop( void* );
+		void WorkerLoop( UInt_t islot );
+
+		std::vector<pthread_t> fWorkers;
+		pthread_mutex_t fMutex;
+		pthread_cond_t  fStart;
+		pthread_cond_t  fDone;
+		Task*    fTask;
+		ULong_t  fGeneration; // incremented for every Run()
+		UInt_t   fPending;    // workers still busy in the current generation
+		Bool_t   fStop;
+
+		NeuroBayesThreadPool( const NeuroBayesThreadPool& );
+		NeuroBayesThreadPool& operator=( const NeuroBayesThreadPool& );
+	};
+}
+
+#endif
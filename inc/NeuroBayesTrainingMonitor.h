@@ -0,0 +1,88 @@
+/****************************************************************
+ * Captures the output of NeuroBayesTeacher::TrainNet. stdout is
+ * redirected into a pipe while the Teacher trains; a reader thread
+ * copies everything to the teacher log and picks out the iteration
+ * lines, so progress, loss and time per iteration are known while
+ * the training runs. Every iteration is appended to a metrics file
+ * (CSV) and reported to an optional observer.
+ *
+ * The reader flushes stdout every 0.1 s, so lines arrive live even
+ * when the job's stdout is a fully buffered file. Iterations are
+ * stamped on arrival: wall and CPU time per iteration are accurate to
+ * that interval, iteration and loss values exactly as printed.
+ *
+ * Internal helper, not part of the ROOT dictionary.
+ * *************************************************************/
+
+#ifndef ROOT_TMVA_NeuroBayesTrainingMonitor
+#define ROOT_TMVA_NeuroBayesTrainingMonitor
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "Rtypes.h"
+
+namespace TMVA {
+
+	class NeuroBayesTrainingMonitor {
+
+	public:
+		struct Iteration {
+			Int_t    iter;   // counted from the first iteration of the training
+			Bool_t   hasLoss;
+			Double_t loss;   // as printed by the Teacher
+			Double_t wall;   // seconds since the previous iteration
+			Double_t cpu;    // process CPU seconds since the previous iteration
+		};
+
+		class Observer {
+		public:
+			virtual ~Observer() {}
+			// called on the reader thread, while the training thread is
+			// blocked in TrainNet
+			virtual void NewIteration( const Iteration& iteration ) = 0;
+		};
+
+		NeuroBayesTrainingMonitor();
+		~NeuroBayesTrainingMonitor();
+
+		// redirect stdout until Stop(). Iterations are numbered from
+		// firstIter + 1; append continues existing log and metrics files.
+		Bool_t Start( const char* logFile, const char* metricsFile, Bool_t append,
+			      Int_t firstIter = 0, Observer* observer = 0 );
+		void   Stop();
+
+		const std::vector<Iteration>& GetIterations() const { return fIterations; }
+
+		// kTRUE for a Teacher line reporting an iteration, e.g.
+		// "iteration 12  entropy 0.8123": "iter", "iter." or "iteration"
+		// followed by the count, optionally a word containing "loss",
+		// "entropy" or "error" followed by the value
+		static Bool_t ParseIteration( const std::string& line, Int_t& iter, Bool_t& hasLoss, Double_t& loss );
+
+	private:
+		static void* ReaderLoop( void* monitor );
+		void ReadPipe();
+		void ProcessLine( const std::string& line );
+		static Double_t WallTime();
+		static Double_t CpuTime();
+
+		int   fPipe;      // read end
+		int   fOriginal;  // stdout before Start
+		FILE* fLog;
+		FILE* fMetrics;
+		Int_t fFirstIter;
+		Observer* fObserver;
+		pthread_t fReader;
+		Bool_t fRunning;
+		Double_t fLastWall;
+		Double_t fLastCpu;
+		std::vector<Iteration> fIterations; // complete after Stop()
+
+		NeuroBayesTrainingMonitor( const NeuroBayesTrainingMonitor& );
+		NeuroBayesTrainingMonitor& operator=( const NeuroBayesTrainingMonitor& );
+	};
+}
+
+#endif
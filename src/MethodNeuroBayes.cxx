@@ -10,10 +10,31 @@
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <iterator>
+#include <iomanip>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 #include <TSystem.h>
 #include <TString.h>
 #include <TObjString.h>
+#include <TList.h>
+#include <TROOT.h>
+#include <TFile.h>
+#include <TChain.h>
 #include <TDirectory.h>
+#include <TRandom3.h>
+#include <TBase64.h>
+#include <TXMLEngine.h>
+#include <RZip.h>
 #include "TMVA/Ranking.h"
 #include "TMVA/Tools.h"
 #include "TMVA/Timer.h"
@@ -24,18 +45,454 @@
 #include <RVersion.h>
 
 #include "MethodNeuroBayes.h"
+#include "NeuroBayesThreadPool.h"
+#include "NeuroBayesNativeNet.h"
+#include "NeuroBayesProcessPool.h"
+#include "NeuroBayesSample.h"
+#include "NeuroBayesExpertiseCache.h"
+#include "NeuroBayesTrainingMonitor.h"
+#include "NeuroBayesInputStatistics.h"
+#include "NeuroBayesProfiler.h"
+#include "NeuroBayesQuantizedNet.h"
+#include "NeuroBayesDownsampler.h"
 
 using namespace std;
 
 ClassImp(TMVA::MethodNeuroBayes)
 
+namespace TMVA {
+	// Thread running MethodNeuroBayes::LoadExpert for ExpertLoading=Background.
+	// The construction is serialised with all others in
+	// NeuroBayesExpertiseCache::NewExpert.
+	class NeuroBayesExpertLoader {
+	public:
+		NeuroBayesExpertLoader( MethodNeuroBayes* method ) : fMethod(method), fRunning(kFALSE) {}
+		~NeuroBayesExpertLoader() { Join(); }
+		Bool_t Start() {
+			fRunning = pthread_create(&fThread, 0, &NeuroBayesExpertLoader::Load, this) == 0;
+			return fRunning;
+		}
+		void Join() {
+			if (fRunning) pthread_join(fThread, 0);
+			fRunning = kFALSE;
+		}
+	private:
+		static void* Load( void* arg ) {
+			static_cast<NeuroBayesExpertLoader*>(arg)->fMethod->LoadExpert();
+			return 0;
+		}
+		MethodNeuroBayes* fMethod;
+		pthread_t fThread;
+		Bool_t fRunning;
+	};
+}
+
 int TMVA::MethodNeuroBayes::CountInstanzes = 0;
+const Long64_t TMVA::MethodNeuroBayes::fgBatchSize = 4096;
+const Long64_t TMVA::MethodNeuroBayes::fgMinEventsPerThread = 256;
+
+namespace {
+	// Scores one contiguous slice of an input block per pool slot, every slot
+	// with its own Expert or all with the shared (reentrant) native engine,
+	// or its reduced-precision copy if one is given.
+	// Slices are fixed by the slot index, so the output order does not
+	// depend on thread scheduling.
+	class ScoreSliceTask : public TMVA::NeuroBayesThreadPool::Task {
+	public:
+		ScoreSliceTask( const std::vector<Expert*>& nets, const TMVA::NeuroBayesNativeNet* native,
+				const TMVA::NeuroBayesQuantizedNet* quantized,
+				const Double_t* inputs, Long64_t nevents, UInt_t nvar, Double_t* values,
+				TMVA::NeuroBayesProfiler* profiler = 0 )
+			: fNets(nets), fNative(native), fQuantized(quantized), fInputs(inputs), fNevents(nevents), fNvar(nvar),
+			  fValues(values), fProfiler(profiler) {}
+
+		void Run( UInt_t islot, UInt_t nslots ) {
+			const Long64_t first = fNevents*islot/nslots;
+			const Long64_t last  = fNevents*(islot+1)/nslots;
+			if (fProfiler) {
+				RunProfiled(islot, first, last);
+				return;
+			}
+			if (fNative) {
+				EvaluateEngine(first, last);
+				return;
+			}
+			Double_t* row = const_cast<Double_t*>(fInputs) + first*fNvar;
+			Expert* net = fNets[islot];
+			for (Long64_t ievt=first; ievt<last; ievt++, row+=fNvar) {
+				fValues[ievt] = net->nb_expert(row);
+			}
+		}
+
+	private:
+		void EvaluateEngine( Long64_t first, Long64_t last ) {
+			if (fQuantized) fQuantized->Evaluate(fInputs + first*fNvar, last - first, fValues + first);
+			else fNative->Evaluate(fInputs + first*fNvar, last - first, fValues + first);
+		}
+
+		// as Run, every slot filling its own histograms
+		void RunProfiled( UInt_t islot, Long64_t first, Long64_t last ) {
+			if (last <= first) return;
+			if (fNative) {
+				const Long64_t start = TMVA::NeuroBayesProfiler::Now();
+				EvaluateEngine(first, last);
+				fProfiler->Fill(islot, TMVA::NeuroBayesProfiler::kExpert, 
+						(TMVA::NeuroBayesProfiler::Now() - start)/(last - first), last - first);
+				return;
+			}
+			Double_t* row = const_cast<Double_t*>(fInputs) + first*fNvar;
+			Expert* net = fNets[islot];
+			for (Long64_t ievt=first; ievt<last; ievt++, row+=fNvar) {
+				const Long64_t start = TMVA::NeuroBayesProfiler::Now();
+				fValues[ievt] = net->nb_expert(row);
+				fProfiler->Fill(islot, TMVA::NeuroBayesProfiler::kExpert, TMVA::NeuroBayesProfiler::Now() - start);
+			}
+		}
+
+	private:
+		const std::vector<Expert*>& fNets;
+		const TMVA::NeuroBayesNativeNet* fNative;
+		const TMVA::NeuroBayesQuantizedNet* fQuantized;
+		const Double_t* fInputs;
+		Long64_t fNevents;
+		UInt_t fNvar;
+		Double_t* fValues;
+		TMVA::NeuroBayesProfiler* fProfiler;
+	};
+
+	// trains one booking with a Teacher of its own in a worker process
+	class IsolatedTrainingJob : public TMVA::NeuroBayesProcessPool::Job {
+	public:
+		IsolatedTrainingJob( TMVA::MethodNeuroBayes* method ) : fMethod(method) {}
+		Int_t Run() { return fMethod->TrainInWorker(); }
+	private:
+		TMVA::MethodNeuroBayes* fMethod;
+	};
+
+	// trains and scores one configuration of a hyperparameter scan
+	class ScanCandidateJob : public TMVA::NeuroBayesProcessPool::Job {
+	public:
+		ScanCandidateJob( TMVA::MethodNeuroBayes* method, UInt_t icand ) : fMethod(method), fCandidate(icand) {}
+		Int_t Run() { return fMethod->TrainScanCandidate(fCandidate); }
+	private:
+		TMVA::MethodNeuroBayes* fMethod;
+		UInt_t fCandidate;
+	};
+
+	class FoldJob : public TMVA::NeuroBayesProcessPool::Job {
+	public:
+		FoldJob( TMVA::MethodNeuroBayes* method, UInt_t ifold ) : fMethod(method), fFold(ifold) {}
+		Int_t Run() { return fMethod->TrainFold(fFold); }
+	private:
+		TMVA::MethodNeuroBayes* fMethod;
+		UInt_t fFold;
+	};
+
+	struct ScanResult {
+		UInt_t   candidate;
+		Int_t    status;
+		Double_t roc;
+		Double_t loss;
+		Double_t walltime;
+	};
+
+	// successful candidates first, best held-out ROC integral on top
+	bool BetterScanResult( const ScanResult& a, const ScanResult& b ) {
+		if ((a.status == 0) != (b.status == 0)) return a.status == 0;
+		return a.roc > b.roc;
+	}
+
+	// Expertise embedded in the weight file. ROOT's zip blocks take at most
+	// 16 MB, larger or incompressible expertises are only base64 encoded.
+	TString EncodeExpertise( const std::string& raw, TString& encoding ) {
+		if (raw.size() < 0xffffff) {
+			int srcsize = raw.size(), tgtsize = raw.size(), irep = 0;
+			std::vector<char> zipped(raw.size());
+			R__zip(6, &srcsize, const_cast<char*>(raw.data()), &tgtsize, &zipped[0], &irep);
+			if (irep > 0 && irep < srcsize) {
+				encoding = "zip+base64";
+				return TBase64::Encode(&zipped[0], irep);
+			}
+		}
+		encoding = "base64";
+		return TBase64::Encode(raw.data(), raw.size());
+	}
+
+	// values of a generated constexpr array, six per line; the literals
+	// reproduce the single precision values exactly
+	void WriteFloatArray( std::ostream& fout, const Float_t* values, UInt_t n, const char* indent ) {
+		std::ostringstream s;
+		s << std::scientific << std::setprecision(8);
+		for (UInt_t i=0; i<n; i++) {
+			if (i%6 == 0) s << (i ? ",\n" : "") << indent;
+			else s << ", ";
+			s << values[i] << "f";
+		}
+		fout << s.str();
+	}
+
+	Double_t Now() {
+		struct timeval tv;
+		gettimeofday(&tv, 0);
+		return tv.tv_sec + 1.e-6*tv.tv_usec;
+	}
+
+	// resident memory and its peak since the last ResetPeakMemory in kB,
+	// from /proc/self/status (Linux); elsewhere only the peak over the
+	// whole process from getrusage, rss is then -1
+	void GetMemoryUsage( Long64_t& rss, Long64_t& peak ) {
+		rss = peak = -1;
+		std::ifstream status("/proc/self/status");
+		std::string key;
+		Long64_t value;
+		while (status >> key) {
+			if (key == "VmRSS:" && status >> value) rss = value;
+			else if (key == "VmHWM:" && status >> value) peak = value;
+		}
+		if (peak < 0) {
+			struct rusage usage;
+			getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+			peak = usage.ru_maxrss/1024;
+#else
+			peak = usage.ru_maxrss;
+#endif
+		}
+	}
+
+	void ResetPeakMemory() {
+		// resets VmHWM to the current RSS, Linux >= 4.0
+		FILE* refs = fopen("/proc/self/clear_refs", "w");
+		if (!refs) return;
+		fputs("5", refs);
+		fclose(refs);
+	}
+
+	const char kSpillMagic[8] = { 'N', 'B', 'S', 'P', 'I', 'L', 'L', '1' };
+
+	// Pipelined ingestion of the training events. Slots 1..nslots-1 are
+	// producers that materialise blocks of events into float rows; slot 0,
+	// the calling thread, is the only one touching the Teacher and passes
+	// the blocks on in event order. Block b is filled by producer
+	// 1 + b%nproducers into ring buffer b%nbuffers, so every buffer always
+	// belongs to the same producer. Without producer threads slot 0 does
+	// both. Several producers need the untransformed event collection:
+	// GetTrainingEvent changes the state of the DataSet.
+	class IngestTask : public TMVA::NeuroBayesThreadPool::Task {
+	public:
+		IngestTask( const TMVA::MethodBase& method, const std::vector<TMVA::Event*>* collection, UInt_t nproducers,
+			    Long64_t nevents, UInt_t nvar, UInt_t signalClass, Float_t holdout,
+			    NeuroBayesTeacher* nb, TMVA::NeuroBayesInputStatistics* stats, std::vector<TMVA::Event*>& validation,
+			    TMVA::NeuroBayesDownsampler* downsampler )
+			: fMethod(method), fCollection(collection), fNproducers(nproducers), fNevents(nevents), fNvar(nvar), 
+			  fSignalClass(signalClass), fHoldout(holdout), fNb(nb), fStats(stats), fValidation(validation),
+			  fDownsampler(downsampler),
+			  fNsignal(0), fConsumeTime(0)
+		{
+			fProduceTimes.assign(nproducers + 1, 0);
+			fNblocks  = (nevents + kBlockSize - 1)/kBlockSize;
+			fBuffers.resize(std::max(nproducers, 1u)*kBuffersPerProducer);
+			for (UInt_t i=0; i<fBuffers.size(); i++) fBuffers[i].block = -1;
+			pthread_mutex_init(&fMutex, 0);
+			pthread_cond_init(&fFilled, 0);
+			pthread_cond_init(&fFreed, 0);
+		}
+		~IngestTask() {
+			pthread_cond_destroy(&fFreed);
+			pthread_cond_destroy(&fFilled);
+			pthread_mutex_destroy(&fMutex);
+		}
+
+		void Run( UInt_t islot, UInt_t ) {
+			if (islot > 0) {
+				Produce(islot);
+				return;
+			}
+			for (Long64_t b=0; b<fNblocks; b++) {
+				Buffer& buffer = fBuffers[b % fBuffers.size()];
+				if (fNproducers == 0) Fill(buffer, b, 0);
+				else {
+					pthread_mutex_lock(&fMutex);
+					while (buffer.block != b) pthread_cond_wait(&fFilled, &fMutex);
+					pthread_mutex_unlock(&fMutex);
+				}
+				Consume(buffer);
+				pthread_mutex_lock(&fMutex);
+				buffer.block = -1;
+				pthread_cond_broadcast(&fFreed);
+				pthread_mutex_unlock(&fMutex);
+			}
+		}
+
+		Long64_t GetNsignal() const        { return fNsignal; }
+		// summed over the producers
+		Double_t GetProduceTime() const {
+			Double_t sum = 0;
+			for (UInt_t i=0; i<fProduceTimes.size(); i++) sum += fProduceTimes[i];
+			return sum;
+		}
+		Double_t GetConsumeTime() const    { return fConsumeTime; }
+
+	private:
+		enum { kBlockSize = 1024, kBuffersPerProducer = 4 };
+		struct Buffer {
+			Long64_t block; // block held for the consumer, -1 if free
+			Long64_t first;
+			Long64_t n;
+			std::vector<Float_t> inputs;
+			std::vector<Float_t> targets;
+			std::vector<Float_t> weights;
+			std::vector<Char_t>  train;
+			std::vector<TMVA::Event*> held; // copies of the held-out events
+		};
+
+		void Produce( UInt_t islot ) {
+			for (Long64_t b=islot-1; b<fNblocks; b+=fNproducers) {
+				Buffer& buffer = fBuffers[b % fBuffers.size()];
+				pthread_mutex_lock(&fMutex);
+				while (buffer.block != -1) pthread_cond_wait(&fFreed, &fMutex);
+				pthread_mutex_unlock(&fMutex);
+				Fill(buffer, b, islot);
+				pthread_mutex_lock(&fMutex);
+				buffer.block = b;
+				pthread_cond_broadcast(&fFilled);
+				pthread_mutex_unlock(&fMutex);
+			}
+		}
+
+		void Fill( Buffer& buffer, Long64_t b, UInt_t islot ) {
+			const Double_t start = Now();
+			buffer.first = b*kBlockSize;
+			buffer.n = std::min<Long64_t>(kBlockSize, fNevents - buffer.first);
+			buffer.inputs.resize(buffer.n*fNvar);
+			buffer.targets.resize(buffer.n);
+			buffer.weights.resize(buffer.n);
+			buffer.train.resize(buffer.n);
+			buffer.held.clear();
+			for (Long64_t i=0; i<buffer.n; i++) {
+				const Long64_t ievt = buffer.first + i;
+				const TMVA::Event* event = fCollection ? (*fCollection)[ievt] : fMethod.GetTrainingEvent(ievt);
+				// events held out for early stopping are not shown to the Teacher
+				buffer.train[i] = !(fHoldout > 0 && TMVA::NeuroBayesSample::InFraction(ievt, fHoldout));
+				if (!buffer.train[i]) {
+					buffer.held.push_back(new TMVA::Event(*event));
+					continue;
+				}
+				Float_t* row = &buffer.inputs[i*fNvar];
+				for (UInt_t ivar=0; ivar<fNvar; ivar++) row[ivar] = event->GetValue(ivar);
+				buffer.targets[i] = event->GetClass() == fSignalClass ? 1 : 0;
+				buffer.weights[i] = event->GetWeight();
+			}
+			fProduceTimes[islot] += Now() - start;
+		}
+
+		void Consume( Buffer& buffer ) {
+			const Double_t start = Now();
+			for (Long64_t i=0; i<buffer.n; i++) {
+				if (!buffer.train[i]) continue;
+				Float_t* row = &buffer.inputs[i*fNvar];
+				if (buffer.targets[i] > 0) fNsignal++;
+				if (fDownsampler) {
+					// the Teacher gets the reservoir after the pass
+					fDownsampler->Add(row, buffer.targets[i], buffer.weights[i]);
+					continue;
+				}
+				fNb->SetWeight(buffer.weights[i]);  //set weight of event
+				fNb->SetTarget(buffer.targets[i]);  // Type is 1 for Signal, 0 for Background 
+				fNb->SetNextInput(fNvar, row);      //pass input to NeuroBayes
+				fStats->Fill(row, buffer.targets[i], buffer.weights[i]);
+			}
+			fValidation.insert(fValidation.end(), buffer.held.begin(), buffer.held.end());
+			buffer.held.clear();
+			fConsumeTime += Now() - start;
+		}
+
+		const TMVA::MethodBase& fMethod;
+		const std::vector<TMVA::Event*>* fCollection;
+		UInt_t   fNproducers;
+		Long64_t fNevents;
+		Long64_t fNblocks;
+		UInt_t   fNvar;
+		UInt_t   fSignalClass;
+		Float_t  fHoldout;
+		NeuroBayesTeacher* fNb;
+		TMVA::NeuroBayesInputStatistics* fStats;
+		std::vector<TMVA::Event*>& fValidation;
+		TMVA::NeuroBayesDownsampler* fDownsampler;
+		std::vector<Buffer> fBuffers;
+		pthread_mutex_t fMutex;
+		pthread_cond_t  fFilled;
+		pthread_cond_t  fFreed;
+		Long64_t fNsignal;
+		std::vector<Double_t> fProduceTimes; // per slot, written by its own thread only
+		Double_t fConsumeTime;
+	};
+
+	// progress bar of a training, driven by the Teacher's iteration lines
+	class ProgressObserver : public TMVA::NeuroBayesTrainingMonitor::Observer {
+	public:
+		ProgressObserver( TMVA::Timer& timer, Int_t firstIter, Int_t niter )
+			: fTimer(timer), fFirstIter(firstIter), fNiter(niter) {}
+		void NewIteration( const TMVA::NeuroBayesTrainingMonitor::Iteration& iteration ) {
+			fTimer.DrawProgressBar( std::min(std::max(iteration.iter - fFirstIter, 0), fNiter) );
+		}
+	private:
+		TMVA::Timer& fTimer;
+		Int_t fFirstIter;
+		Int_t fNiter;
+	};
+
+	// shared by all bookings, so their trainings can overlap
+	TMVA::NeuroBayesProcessPool& TrainingPool() {
+		static TMVA::NeuroBayesProcessPool pool;
+		return pool;
+	}
+
+	// analysis reports generated in the background; the pool waits for
+	// reports still running when the process exits
+	TMVA::NeuroBayesProcessPool& AnalysisPool() {
+		static TMVA::NeuroBayesProcessPool pool;
+		return pool;
+	}
+
+	class AnalysisJob : public TMVA::NeuroBayesProcessPool::Job {
+	public:
+		AnalysisJob( const std::string& command ) : fCommand(command) {}
+		Int_t Run() {
+			execl("/bin/sh", "sh", "-c", fCommand.c_str(), (char*)0);
+			return 127;
+		}
+	private:
+		std::string fCommand;
+	};
+}
 
 TMVA::MethodNeuroBayes::MethodNeuroBayes(DataSetInfo& theData, 
                                        const TString& theWeightFile,  
                                        TDirectory* theTargetDir)
 	:TMVA::MethodBase( Types::kPlugins, theData, theWeightFile, theTargetDir ){
 	fTask=0;
+	Net = NULL;
+	fThreadPool = NULL;
+	fNative = NULL;
+	fQuantized = NULL;
+	fExpertise = NULL;
+	preproFlagsarray = NULL;
+	fTrainingJob = -1;
+	fAnalysisJob = -1;
+	fSample = NULL;
+	fInputStats = NULL;
+	fProfiler = NULL;
+	fDownsampleSpeedup = 1;
+	fTrainingIter = 0;
+	fFoldsTrainedHere = kFALSE;
+	fFoldEventHint = -1;
+	fExpertState = kExpertNone;
+	fExpertLoader = NULL;
+	fExpertLoadTime = 0;
+	fCreateExpertTime = 0;
+	fCheckedNet = NULL;
+	fCheckedNetPassed = kFALSE;
 
 	InitNeuroBayes(fTask);
 	Log() << kINFO << "Expert Constructor was called" << Endl;
@@ -50,23 +507,45 @@ TMVA::MethodNeuroBayes::MethodNeuroBayes( const TString& jobName,
 {
 	fTask = 1;
 	Net = NULL;
+	fThreadPool = NULL;
+	fNative = NULL;
+	fQuantized = NULL;
+	fExpertise = NULL;
+	preproFlagsarray = NULL;
+	fTrainingJob = -1;
+	fAnalysisJob = -1;
+	fSample = NULL;
+	fInputStats = NULL;
+	fProfiler = NULL;
+	fDownsampleSpeedup = 1;
+	fTrainingIter = 0;
+	fFoldsTrainedHere = kFALSE;
+	fFoldEventHint = -1;
+	fExpertState = kExpertNone;
+	fExpertLoader = NULL;
+	fExpertLoadTime = 0;
+	fCreateExpertTime = 0;
+	fCheckedNet = NULL;
+	fCheckedNetPassed = kFALSE;
 	InitNeuroBayes(fTask);
 	MyID = CountInstanzes;
 	//Log() << kINFO << methodTitle << " got ID " << MyID << " theTargetDir =  " << theTargetDir << Endl;
 
 	CountInstanzes++;
-	if(MyID > 0) {
-		Log() << kWARNING << "This NeuroBayes instance was not created as first one."<<Endl;
-		Log() << kWARNING << "Because Teacher is a singleton you won't get useful results from this Method" << Endl;
-		Log() << kWARNING << "Use only one Teacher at a time until this is fixed" << Endl;
-	}
 
 	TeacherConfigured = false;
 	Log() << kINFO << "Teacher Constructor was called" << Endl;
 }
 
 TMVA::MethodNeuroBayes::~MethodNeuroBayes(){
-	delete Net;
+	if (fTrainingJob >= 0) TrainingPool().Cancel(fTrainingJob);
+	WaitForAnalysis();
+	if (fProfiler) PrintProfile();
+	ClearExpert();
+	delete fProfiler;
+	delete fSample;
+	delete fInputStats;
+	ClearValidationSample();
 }
 
 Bool_t TMVA::MethodNeuroBayes::HasAnalysisType( Types::EAnalysisType type, UInt_t numberClasses, UInt_t numberTargets )
@@ -113,35 +592,305 @@ void TMVA::MethodNeuroBayes::InitEventSample( void )
 {
    	if (!HasTrainingTree()) Log() << kFATAL << "<Init> Data().TrainingTree() is zero pointer" << Endl;
 
-   	Int_t nevents = Data()->GetNTrainingEvents();
-	Int_t nsignal=0;
+	// Events are fetched and converted by IngestThreads producer threads
+	// while the calling thread feeds the Teacher, see IngestTask. More
+	// than one producer reads the event collection directly, so it
+	// requires that no variable transformation is booked. With the
+	// Downsample options the events go to a reservoir first, which is
+	// passed to the Teacher after the pass.
+   	const Long64_t nevents = Data()->GetNTrainingEvents();
+	const UInt_t nvar = GetNvar();
+	ResetInputStatistics();
+
+	const Double_t kept = fEarlyStopping ? 1 - fValidationFraction : 1;
+	NeuroBayesDownsampler* downsampler = CreateDownsampler(Long64_t(Data()->GetNEvtSigTrain()*kept + 0.5),
+							       Long64_t(Data()->GetNEvtBkgdTrain()*kept + 0.5));
+
+	const Bool_t transformed = GetTransformationHandler().GetTransformationList().GetSize() > 0;
+	UInt_t nproducers = std::max(fIngestThreads, 0);
+	if (nproducers > 1 && transformed) {
+		Log() << kINFO << "<InitEventSample> : variable transformations are booked, using one producer thread" << Endl;
+		nproducers = 1;
+	}
+	const std::vector<Event*>* collection = nproducers > 1 ? &Data()->GetEventCollection(Types::kTraining) : 0;
+
+	NeuroBayesThreadPool pool(nproducers + 1);
+	nproducers = pool.GetNThreads() - 1;
+	IngestTask task(*this, collection, nproducers, nevents, nvar, DataInfo().GetClassInfo("Signal")->GetNumber(), 
+			fEarlyStopping ? fValidationFraction : 0, nb, fInputStats, fValidationSample, downsampler);
+	const Double_t start = Now();
+	pool.Run(&task);
+	const Double_t wall = std::max(Now() - start, 1.e-9);
+	if (downsampler) {
+		FeedDownsampled(*downsampler);
+		delete downsampler;
+	}
+
+	const Long64_t nsignal = task.GetNsignal();
+	Log() << kINFO << "<InitEventSample> : found " << 
+		nsignal << " Signal Events and " << nevents - nsignal - fValidationSample.size() << " Background Events " << Endl;
+	if (fEarlyStopping) Log() << kINFO << "<InitEventSample> : " << fValidationSample.size() << " events held out for validation" << Endl;
+	Log() << kINFO << Form("<InitEventSample> : %lld events in %.2f s (%.0f events/s) with %u producer thread(s): "
+			       "fetching %.0f events/s per thread, Teacher input %.0f events/s", 
+			       nevents, wall, nevents/wall, nproducers,
+			       nevents/std::max(task.GetProduceTime(), 1.e-9),
+			       nevents/std::max(task.GetConsumeTime(), 1.e-9)) << Endl;
+}
+
+void TMVA::MethodNeuroBayes::IngestTrainingEvents()
+{
+	// pass the training events to the Teacher, from the input cache if enabled
+	if (fInputCache == "") {
+		InitEventSample();
+		return;
+	}
+	NeuroBayesSample sample(GetNvar());
+	LoadSample(sample);
+	if (!fEarlyStopping) {
+		FeedTeacher(sample);
+		return;
+	}
+
+	// same validation events as InitEventSample, rebuilt from the cached rows
+	const UInt_t signalClass     = DataInfo().GetClassInfo("Signal")->GetNumber();
+	const UInt_t backgroundClass = DataInfo().GetClassInfo("Background")->GetNumber();
+	std::vector<Char_t> trainMask(sample.GetNEvents());
+	std::vector<Float_t> values(GetNvar()), none;
+	for (Long64_t ievt=0; ievt<sample.GetNEvents(); ievt++) {
+		trainMask[ievt] = !NeuroBayesSample::InFraction(ievt, fValidationFraction);
+		if (trainMask[ievt]) continue;
+		std::copy(sample.GetInputs(ievt), sample.GetInputs(ievt) + GetNvar(), values.begin());
+		fValidationSample.push_back(new Event(values, none, none, sample.GetTarget(ievt) > 0.5 ? signalClass : backgroundClass, 
+						      sample.GetWeight(ievt)));
+	}
+	FeedTeacher(sample, &trainMask);
+	Log() << kINFO << "<IngestTrainingEvents> : " << fValidationSample.size() << " events held out for validation" << Endl;
+}
+
+void TMVA::MethodNeuroBayes::LoadSample( NeuroBayesSample& sample )
+{
+	// map the training inputs from the input cache, or run the event loop
+	// and store its result there for the next training
+	ULong64_t key = 0;
+	TString cacheFile;
+	Bool_t cached = fInputCache != "";
+	if (cached && !GetInputCacheKey(key)) {
+		Log() << kWARNING << "Training trees do not come from input files that can be identified, not using the input cache" << Endl;
+		cached = kFALSE;
+	}
+	if (cached) {
+		cacheFile = fInputCache + "/" + Form("%016llx", key) + ".nbcache";
+		if (sample.MapCache(cacheFile, key)) {
+			Log() << kINFO << "Replaying " << sample.GetNEvents() << " training events from input cache " << cacheFile << Endl;
+			return;
+		}
+	}
+
+	FillSample(sample);
+
+	if (cached) {
+		gSystem->mkdir(fInputCache, kTRUE);
+		if (sample.WriteCache(cacheFile, key)) Log() << kINFO << "Training inputs written to input cache " << cacheFile << Endl;
+		else Log() << kWARNING << "Could not write input cache " << cacheFile << Endl;
+	}
+}
+
+Bool_t TMVA::MethodNeuroBayes::GetInputCacheKey( ULong64_t& key )
+{
+	// Identifies the training inputs without reading an event: the dataset
+	// definition (class cuts and weights, split and normalisation options,
+	// variables, transformations, number of training events) and the input
+	// files with size and modification time. Input files are the ROOT files
+	// open read-only, with the trees read from them, and the files of every
+	// TChain. Trees filled in memory or in a writable file are not covered.
+	TString id = Form("%s|%lld|%lld|%s|%s", DataInfo().GetName(), Data()->GetNEvtSigTrain(), Data()->GetNEvtBkgdTrain(),
+			  DataInfo().GetSplitOptions().Data(), DataInfo().GetNormalization().Data());
+	for (UInt_t icls=0; icls<DataInfo().GetNClasses(); icls++) {
+		const ClassInfo* info = DataInfo().GetClassInfo(icls);
+		id += "|" + info->GetName() + ":" + info->GetCut().GetTitle() + ":" + info->GetWeight();
+	}
+	for (UInt_t ivar=0; ivar<GetNvar(); ivar++) id += "|" + DataInfo().GetVariableInfo(ivar).GetExpression();
+	TList& transformations = GetTransformationHandler().GetTransformationList();
+	for (Int_t i=0; i<transformations.GetSize(); i++) id += TString("|") + transformations.At(i)->GetName();
+
+	// sorted, the order files were opened in does not matter
+	std::vector<TString> inputs;
+	TIter files(gROOT->GetListOfFiles());
+	while (TFile* file = dynamic_cast<TFile*>(files())) {
+		if (file->IsWritable()) continue;
+		TString input;
+		if (!GetFileIdentity(file->GetName(), input)) return kFALSE;
+		TIter objects(file->GetList());
+		while (TObject* object = objects()) {
+			const TTree* tree = dynamic_cast<const TTree*>(object);
+			if (tree) input += Form("|%s:%lld", tree->GetName(), tree->GetEntries());
+		}
+		inputs.push_back(input);
+	}
+	TIter specials(gROOT->GetListOfSpecials());
+	while (TObject* special = specials()) {
+		const TChain* chain = dynamic_cast<const TChain*>(special);
+		if (!chain) continue;
+		TIter elements(chain->GetListOfFiles());
+		while (TObject* element = elements()) {
+			TString input;
+			if (!GetFileIdentity(element->GetTitle(), input)) return kFALSE;
+			inputs.push_back(input + "|" + chain->GetName() + ":" + element->GetName());
+		}
+	}
+	if (inputs.empty()) return kFALSE;
+	std::sort(inputs.begin(), inputs.end());
+	for (UInt_t i=0; i<inputs.size(); i++) id += "|" + inputs[i];
+	key = NeuroBayesSample::Hash(id.Data(), id.Length());
+	return kTRUE;
+}
 
-	// event loop on Training Data
- 	for (Int_t ievt=0; ievt<nevents; ievt++) {
+Bool_t TMVA::MethodNeuroBayes::GetFileIdentity( const TString& path, TString& identity )
+{
+	// path, size and modification time; kFALSE if the file cannot be stat'ed
+	FileStat_t stat;
+	if (gSystem->GetPathInfo(path, stat) != 0) return kFALSE;
+	identity = Form("%s:%lld:%ld", path.Data(), stat.fSize, stat.fMtime);
+	return kTRUE;
+}
 
+void TMVA::MethodNeuroBayes::FillSample( NeuroBayesSample& sample )
+{
+	// one pass over the training events into memory, in the form the
+	// Teacher takes them
+	if (!HasTrainingTree()) Log() << kFATAL << "<Init> Data().TrainingTree() is zero pointer" << Endl;
+
+	const Long64_t nevents = Data()->GetNTrainingEvents();
+	const UInt_t nvar = GetNvar();
+	std::vector<Float_t> row(nvar);
+	Long64_t nsignal = 0;
+	sample.Reserve(nevents);
+	for (Long64_t ievt=0; ievt<nevents; ievt++) {
 		const Event* event = GetTrainingEvent(ievt);
+		for (UInt_t ivar=0; ivar<nvar; ivar++) row[ivar] = event->GetValue(ivar);
+		const Bool_t isSignal = DataInfo().IsSignal(event);
+		if (isSignal) nsignal++;
+		sample.AddEvent(&row[0], isSignal ? 1 : 0, event->GetWeight());
+	}
+	Log() << kINFO << "<FillSample> : kept " << nsignal << " Signal Events and " 
+	      << nevents - nsignal << " Background Events in memory" << Endl;
+}
 
-   		int nvar = GetNvar();
+void TMVA::MethodNeuroBayes::FeedTeacher( const NeuroBayesSample& sample, const std::vector<Char_t>* mask )
+{
+	// pass the (selected) events of an in-memory sample to the Teacher
+	Long64_t nfed = 0;
+	ResetInputStatistics();
 
-		float InputArray[nvar];   
-		memset(InputArray,-999,nvar*sizeof(float)); //reset
+	Long64_t nselected[2] = { 0, 0 };
+	for (Long64_t ievt=0; ievt<sample.GetNEvents(); ievt++) {
+		if (!mask || (*mask)[ievt]) nselected[sample.GetTarget(ievt) > 0.5 ? 1 : 0]++;
+	}
+	NeuroBayesDownsampler* downsampler = CreateDownsampler(nselected[1], nselected[0]);
+	if (downsampler) {
+		for (Long64_t ievt=0; ievt<sample.GetNEvents(); ievt++) {
+			if (mask && !(*mask)[ievt]) continue;
+			downsampler->Add(sample.GetInputs(ievt), sample.GetTarget(ievt), sample.GetWeight(ievt));
+		}
+		FeedDownsampled(*downsampler);
+		delete downsampler;
+		return;
+	}
 
-		nb->SetWeight(event->GetWeight());  //set weight of event
+	for (Long64_t ievt=0; ievt<sample.GetNEvents(); ievt++) {
+		if (mask && !(*mask)[ievt]) continue;
+		nb->SetWeight(sample.GetWeight(ievt));
+		nb->SetTarget(sample.GetTarget(ievt));
+		nb->SetNextInput(sample.GetNvar(), const_cast<Float_t*>(sample.GetInputs(ievt)));
+		fInputStats->Fill(sample.GetInputs(ievt), sample.GetTarget(ievt), sample.GetWeight(ievt));
+		nfed++;
+	}
+	Log() << kINFO << "<FeedTeacher> : passed " << nfed << " of " << sample.GetNEvents() << " events to the Teacher" << Endl;
+}
 
-      		// set Target
-		Double_t type = 0.0;
-		if( DataInfo().IsSignal(event) ) { type = 1.0; nsignal++; }
-      		nb->SetTarget( type ) ; // Type is 1 for Signal, 0 for Background 
+Bool_t TMVA::MethodNeuroBayes::ParseDownsampleFractions( Double_t fractions[2] ) const
+{
+	// "Signal=f,Background=f", a class not listed keeps all its events
+	fractions[0] = fractions[1] = 1;
+	TObjArray* settings = fDownsampleFraction.Tokenize(",");
+	Bool_t ok = kTRUE;
+	for (Int_t i=0; i<settings->GetEntries(); i++) {
+		TObjArray* pair = ((TObjString*)settings->At(i))->GetString().Tokenize("=");
+		if (pair->GetEntries() != 2) ok = kFALSE;
+		else {
+			TString name  = ((TObjString*)pair->At(0))->GetString().Strip(TString::kBoth);
+			TString value = ((TObjString*)pair->At(1))->GetString().Strip(TString::kBoth);
+			const Double_t fraction = value.Atof();
+			if (!value.IsFloat() || fraction <= 0 || fraction > 1) ok = kFALSE;
+			else if (name == "Signal") fractions[1] = fraction;
+			else if (name == "Background") fractions[0] = fraction;
+			else ok = kFALSE;
+		}
+		delete pair;
+	}
+	delete settings;
+	return ok;
+}
 
-		for (UInt_t ivar=0; ivar<GetNvar(); ivar++) {
-	        	Float_t value  = event->GetValue(ivar);
-			InputArray[ivar] = value;
+TMVA::NeuroBayesDownsampler* TMVA::MethodNeuroBayes::CreateDownsampler( Long64_t nsignal, Long64_t nbackground ) const
+{
+	// reservoir for the expected number of events of each class, 0 if
+	// the Downsample options keep all of them
+	Long64_t signalQuota = nsignal, backgroundQuota = nbackground;
+	if (fDownsampleEvents > 0) {
+		NeuroBayesDownsampler::SplitTarget(fDownsampleEvents, nsignal, nbackground, signalQuota, backgroundQuota);
+	}
+	else if (fDownsampleFraction != "") {
+		Double_t fractions[2];
+		ParseDownsampleFractions(fractions);
+		signalQuota     = Long64_t(std::ceil(fractions[1]*nsignal));
+		backgroundQuota = Long64_t(std::ceil(fractions[0]*nbackground));
+	}
+	if (signalQuota >= nsignal && backgroundQuota >= nbackground) return 0;
+	return new NeuroBayesDownsampler(GetNvar(), signalQuota, backgroundQuota);
+}
+
+void TMVA::MethodNeuroBayes::FeedDownsampled( NeuroBayesDownsampler& downsampler )
+{
+	// pass the reservoir to the Teacher with the class normalisation restored
+	downsampler.Finish();
+	Long64_t nseen = 0, nkept = 0;
+	const char* names[2] = { "Background", "Signal" };
+	for (UInt_t iclass=0; iclass<2; iclass++) {
+		const Float_t target = iclass == NeuroBayesDownsampler::kSignal ? 1 : 0;
+		for (Long64_t i=0; i<downsampler.GetNKept(iclass); i++) {
+			const Float_t weight = downsampler.GetWeight(iclass, i);
+			nb->SetWeight(weight);
+			nb->SetTarget(target);
+			nb->SetNextInput(downsampler.GetNvar(), const_cast<Float_t*>(downsampler.GetInputs(iclass, i)));
+			fInputStats->Fill(downsampler.GetInputs(iclass, i), target, weight);
 		}
-		//pass input to NeuroBayses
-          	nb->SetNextInput(nvar,InputArray);
-   	}
-	Log() << kINFO << "<InitEventSample> : found " << 
-		nsignal << " Signal Events and " << nevents - nsignal << " Background Events " << Endl;
+		nseen += downsampler.GetNSeen(iclass);
+		nkept += downsampler.GetNKept(iclass);
+		Log() << kINFO << Form("<Downsample> : %s kept %lld of %lld events (%.3g%%), weights scaled by %.4g",
+				       names[iclass], downsampler.GetNKept(iclass), downsampler.GetNSeen(iclass),
+				       100.*downsampler.GetNKept(iclass)/std::max<Long64_t>(downsampler.GetNSeen(iclass), 1),
+				       downsampler.GetScale(iclass)) << Endl;
+	}
+	// the Teacher's time per iteration scales with the number of events
+	fDownsampleSpeedup = nkept > 0 ? Double_t(nseen)/nkept : 1;
+	Log() << kINFO << Form("<Downsample> : Teacher trains on %lld of %lld events, expected training speedup %.1fx",
+			       nkept, nseen, fDownsampleSpeedup) << Endl;
+}
+
+void TMVA::MethodNeuroBayes::ScoreExpertise( const TString& expertiseFile, const NeuroBayesSample& sample,
+					     const std::vector<Long64_t>& events, std::vector<Double_t>& responses )
+{
+	// nb_expert responses of an expertise on the listed sample events
+	Expert* expert = NeuroBayesExpertiseCache::NewExpert(0, expertiseFile.Data());
+	std::vector<Double_t> row(sample.GetNvar());
+	responses.resize(events.size());
+	for (UInt_t i=0; i<events.size(); i++) {
+		const Float_t* inputs = sample.GetInputs(events[i]);
+		std::copy(inputs, inputs + sample.GetNvar(), row.begin());
+		responses[i] = expert->nb_expert(&row[0]);
+	}
+	delete expert;
 }
 
 void TMVA::MethodNeuroBayes::DeclareOptions() 
@@ -151,6 +900,9 @@ void TMVA::MethodNeuroBayes::DeclareOptions()
 
 	Log() << kINFO <<  "Declare NeuroBayes Options" << Endl;
 	DeclareOptionRef(frunAnalysis=kTRUE, "Analysis", "You may chose whether you want to run the NeuroBayes analysis macro or not (default=yes)");
+	DeclareOptionRef(fAnalysisMode="Sync", "AnalysisMode", "Sync: wait for the analysis report after training; Async: generate it in the background while TMVA continues, joined at the end of the job");
+	AddPreDefVal(TString("Sync"));
+	AddPreDefVal(TString("Async"));
 	DeclareOptionRef(fRegularisation="REG", "Regularisation", "Type of regularisation: Possible choices are: OFF , REG (default), ARD , ASR, ALL.");
 	AddPreDefVal(TString("OFF"));
 	AddPreDefVal(TString("REG"));
@@ -186,15 +938,110 @@ void TMVA::MethodNeuroBayes::DeclareOptions()
 
 	DeclareOptionRef(fNBIndiPreproFlagList="", "NBIndiPreproFlagList", "Set individual preprocessing flags in a coma seperated string,  e.g. 12,12,12,12. See NeuroBayes-HowTo for infos");
 	DeclareOptionRef(fNBIndiPreproFlagVarname="", "NBIndiPreproFlagByVarname", "Set individual preprocessing flags in a coma seperated string, e.g. varname1=<PreproFlag>.<1stPreproparam>.<2ndPreproparam>...,varname2=19,...");
+
+	DeclareOptionRef(fIsolatedTraining=kFALSE, "IsolatedTraining", "Train every booking with its own Teacher in a worker process, so several NeuroBayes bookings can be trained in one job (default=no)");
+	DeclareOptionRef(fTrainingWorkers=0, "TrainingWorkers", "Maximum number of concurrent IsolatedTraining workers, 0 = number of cores");
+
+	DeclareOptionRef(fScan="", "Scan", "Hyperparameter scan, e.g. Regularisation{REG|ARD},Momentum{0|0.5} or with Random search also ranges LearningSpeed{0.5~2}. Parameters: Regularisation, Preprocessing, Momentum, LearningSpeed, WeightUpdate, TrainingMethod");
+	DeclareOptionRef(fScanSamples=0, "ScanSamples", "Number of random Scan candidates, 0 = full grid");
+	DeclareOptionRef(fScanHoldout=0.25, "ScanHoldout", "Fraction of the training events held out to rank the Scan candidates");
+
+	DeclareOptionRef(fInputCache="", "InputCache", "Directory of a binary cache of the training inputs; retraining on the same inputs replays it instead of running the TMVA event loop. Keyed by the dataset definition and the read-only input files (path, size, modification time), trees filled in memory are not cached");
+
+	DeclareOptionRef(fEarlyStopping=kFALSE, "EarlyStopping", "Stop training once the loss on held-out validation events has not improved for Patience checks (default=no)");
+	DeclareOptionRef(fValidationFraction=0.2, "ValidationFraction", "Fraction of the training events held out for EarlyStopping");
+	DeclareOptionRef(fPatience=3, "Patience", "Number of validation checks without improvement before EarlyStopping ends the training");
+	DeclareOptionRef(fEarlyStoppingChunk=10, "EarlyStoppingChunk", "Training iterations between two EarlyStopping validation checks");
+
+	DeclareOptionRef(fEmbedExpertise=kFALSE, "EmbedExpertise", "Store the expertise itself (compressed) in the XML weight file and set up the Expert from it, not from the .nb file (default=no)");
+
+	DeclareOptionRef(fMetricsFile="nb_teacher_metrics.csv", "MetricsFile", "CSV file receiving iteration, loss, wall and CPU time of every training iteration as it happens, empty to disable");
+
+	DeclareOptionRef(fIngestThreads=0, "IngestThreads", "Threads fetching training events while the Teacher is fed; 0 (default) fetches on the feeding thread as before, more than one requires no variable transformations");
+
+	DeclareOptionRef(fWarmStart="", "WarmStart", "Expertise (.nb) or weight file (.xml) of an earlier training with the same variables to start from, instead of random weights. Needs a NeuroBayes Teacher with SetInitialExpertise (NEUROBAYES_TEACHER_WARMSTART defined in NeuroBayesTeacher.hh, so far only the bench stand-in), otherwise rejected at booking");
+	DeclareOptionRef(fWarmStartIter=20, "WarmStartIter", "Training iterations with WarmStart, replacing NtrainingIter");
+
+	DeclareOptionRef(fLowMemory=kFALSE, "LowMemory", "Move TMVA's copy of the training events to a spill file while the Teacher trains and reload it for the test phase, so the inputs are not held twice (default=no)");
+
+	DeclareOptionRef(fDownsampleEvents=0, "DownsampleEvents", "Train on a random subset of about N events, split evenly over signal and background (a smaller class keeps all its events); event weights are scaled so each class keeps its sum of weights (default=0, off)");
+	DeclareOptionRef(fDownsampleFraction="", "DownsampleFraction", "Fraction of the training events of each class passed to the Teacher, e.g. Background=0.1 or Signal=0.5,Background=0.05; weights are scaled as for DownsampleEvents");
+
+	DeclareOptionRef(fKFolds=1, "KFolds", "Train N networks in parallel worker processes, fold k leaving out the training events with number%N == k; evaluation uses the fold that did not see a training event and the mean of all folds otherwise (default=1, off)");
+
+	DeclareOptionRef(fNThreads=1, "NThreads", "Number of threads used to score large event blocks, each thread with its own Expert (default=1)");
+
+	DeclareOptionRef(fProfile=kFALSE, "Profile", "Record call counts and latency histograms of the evaluation and the Expert setup, printed and written to ProfileFile when the method is deleted; also enabled by NEUROBAYES_PROFILE=1 (default=no)");
+	DeclareOptionRef(fProfileFile="", "ProfileFile", "File receiving the Profile summary, default <job>_<method>.NB_profile.txt");
+
+	DeclareOptionRef(fExpertLoading="Eager", "ExpertLoading", "When the Expert is created after training or reading the weights: Eager (at once), Lazy (at the first evaluation) or Background (on a thread, the first evaluation waits for it if needed); NEUROBAYES_EXPERT_LOADING overrides it");
+	AddPreDefVal(TString("Eager"));
+	AddPreDefVal(TString("Lazy"));
+	AddPreDefVal(TString("Background"));
+
+	DeclareOptionRef(fInferenceBackend="Expert", "InferenceBackend", "Evaluate with the NeuroBayes Expert (default) or the in-plugin SIMD engine: Expert, Native. Native is experimental: its expertise layout is that of the bench stand-in, real NeuroBayes expertises fail the NativeTolerance check and are evaluated by the Expert");
+	AddPreDefVal(TString("Expert"));
+	AddPreDefVal(TString("Native"));
+	DeclareOptionRef(fNativeTolerance=1.e-4, "NativeTolerance", "Maximum deviation of the Native backend from nb_expert accepted at load time, else Expert is used");
+	DeclareOptionRef(fNativePrecision="Float", "NativePrecision", "Weights of the Native backend: Float, Half (float16) or Int8 (int8 weights and inputs, per node/event scales); experimental like InferenceBackend=Native");
+	AddPreDefVal(TString("Float"));
+	AddPreDefVal(TString("Half"));
+	AddPreDefVal(TString("Int8"));
+	DeclareOptionRef(fQuantizationTolerance=0.01, "QuantizationTolerance", "Maximum deviation of a Half or Int8 network from nb_expert on the test sample, else the float network is used");
 }
 
 void TMVA::MethodNeuroBayes::ProcessOptions()
 {
    Log()<< "Processing Options" << Endl;
+	InitProfiler();
    // decode the options in the option string
 	if(fTask == 1 && TeacherConfigured==false) {
-		//MethodBase::ProcessOptions();
-   		//possible way to set NeuroBayes Layout and PreproFlags
+		if (fEarlyStopping && (fValidationFraction <= 0 || fValidationFraction >= 1))
+			Log() << kFATAL << "ValidationFraction has to be between 0 and 1" << Endl;
+		if (fScan != "" && fKFolds > 1) Log() << kFATAL << "Scan and KFolds cannot be combined" << Endl;
+		if (fDownsampleEvents < 0) Log() << kFATAL << "DownsampleEvents has to be positive or 0" << Endl;
+		if (fDownsampleEvents > 0 && fDownsampleFraction != "")
+			Log() << kFATAL << "DownsampleEvents and DownsampleFraction cannot be combined" << Endl;
+		if (fWarmStart != "" && fWarmStartIter <= 0) Log() << kFATAL << "WarmStartIter has to be positive" << Endl;
+#ifndef NEUROBAYES_TEACHER_WARMSTART
+		if (fWarmStart != "") Log() << kFATAL << "WarmStart: this NeuroBayes Teacher cannot start from an expertise" << Endl;
+#endif
+		if (fWarmStart != "" && fScan != "") Log() << kWARNING << "WarmStart is not used by the Scan candidates" << Endl;
+		else if (fWarmStart != "") LoadWarmStart();
+		if (fLowMemory && (fScan != "" || fKFolds > 1 || fIsolatedTraining))
+			Log() << kWARNING << "LowMemory only applies to the training in this process, not to Scan, KFolds or IsolatedTraining" << Endl;
+		Double_t fractions[2];
+		if (!ParseDownsampleFractions(fractions))
+			Log() << kFATAL << "DownsampleFraction \"" << fDownsampleFraction << "\" is not of the form Signal=f,Background=f with 0 < f <= 1" << Endl;
+		if (fScan != "") {
+			// every candidate configures its own Teacher in its worker process
+			BuildScanCandidates();
+		}
+		else if (fKFolds > 1) {
+			// every fold configures its own Teacher in its worker process
+			if (fEarlyStopping) Log() << kWARNING << "EarlyStopping is not used with KFolds" << Endl;
+		}
+		else if (fIsolatedTraining) {
+			// the Teacher of this booking is configured in its worker process
+			TrainingPool().SetMaxWorkers(fTrainingWorkers);
+			fTrainingJob = TrainingPool().Submit(new IsolatedTrainingJob(this));
+		}
+		else {
+			if(MyID > 0) {
+				Log() << kWARNING << "This NeuroBayes instance was not created as first one."<<Endl;
+				Log() << kWARNING << "Because Teacher is a singleton you won't get useful results from this Method" << Endl;
+				Log() << kWARNING << "Use only one Teacher at a time or set IsolatedTraining" << Endl;
+			}
+			ConfigureTeacher();
+		}
+		TeacherConfigured = true;
+	}
+	else Log() << kWARNING << "Teacher already configured or not in Trainingmode. No configurations done!" << Endl;
+}
+
+void TMVA::MethodNeuroBayes::ConfigureTeacher()
+{
+		//possible way to set NeuroBayes Layout and PreproFlags
 
  		nb->NB_DEF_PRE(fPreprocessing);			// Global Preprocessing Flag 
   		nb->NB_DEF_REG(fRegularisation);           	// 'OFF','REG' (def) ,'ARD','ASR','ALL'
@@ -208,11 +1055,13 @@ void TMVA::MethodNeuroBayes::ProcessOptions()
   		nb->NB_DEF_MAXLEARN(fLimitLearningSpeed);     	// multiplicative factor to limit the global learning speed
 								// in any direction, this number should be smaller than NB_DEF_SPEED
 
-  		nb->NB_DEF_ITER(fNtrainingIter);             	// number of training iteration
+  		fTrainingIter = fNtrainingIter;
+  		nb->NB_DEF_ITER(fTrainingIter);             	// number of training iteration
   		nb->NB_DEF_METHOD(fTrainingMethod);            	// Training Method
 		//nb->NB_DEF_INITIALPRUNE(fPruning);
 		//nb->NB_DEF_RTRAIN(fTrainTestRatio);		// Ratio of Events to use for Trainig, Rest is used for Testing
 
+		delete [] preproFlagsarray;
 		preproFlagsarray = new TString [GetNvar()];
 		for (UInt_t ivar=0; ivar<GetNvar(); ivar++) preproFlagsarray[ivar] = "";
 		if( fNBIndiPreproFlagList!="" ) {
@@ -222,34 +1071,669 @@ void TMVA::MethodNeuroBayes::ProcessOptions()
 		else if( fNBIndiPreproFlagVarname!="" ) {
 			ParseIndiviPreproFlagByVarname();
 		}
-		TeacherConfigured = true;
-	}
-	else Log() << kWARNING << "Teacher already configured or not in Trainingmode. No configurations done!" << Endl;
 }
 
 //Train the Net
 void TMVA::MethodNeuroBayes::Train( void ){
+	if (fScan != "") {
+		TrainScan();
+		return;
+	}
+	if (fKFolds > 1) {
+		TrainKFolds();
+		return;
+	}
+	if (fIsolatedTraining) {
+		TrainIsolated();
+		return;
+	}
+	TrainInProcess();
+}
+
+void TMVA::MethodNeuroBayes::TrainInProcess()
+{
 	InitNeuroBayes(fTask);
-	InitEventSample();
-	//perform training
+	LogMemory("setup");
+	IngestTrainingEvents();
+	LogMemory("ingestion");
+	// the Teacher holds its own copy of the inputs from here on
+	if (fLowMemory) ReleaseTrainingEvents();
+	ApplyWarmStart();
+	if (fEarlyStopping) TrainWithEarlyStopping();
+	else TrainTeacher();
+	LogMemory("training");
+
+	if(frunAnalysis) {
+		runAnalysis(fAnalysisMode == "Async");
+		LogMemory("analysis");
+	}
+	//Setup Expert, it might be needed...
+	SetupExpert(NBOutputFile + ".nb");
+	LogMemory("expert construction");
+	if (fLowMemory) {
+		ReloadTrainingEvents();
+		LogMemory("reloading the training events");
+	}
+}
+
+void TMVA::MethodNeuroBayes::LogMemory( const char* stage )
+{
+	// resident memory after a stage of the training and its peak during it
+	Long64_t rss, peak;
+	GetMemoryUsage(rss, peak);
+	if (rss >= 0) Log() << kINFO << Form("<Memory> : after %s: RSS %.1f MB, peak %.1f MB", stage, rss/1024., peak/1024.) << Endl;
+	else Log() << kINFO << Form("<Memory> : after %s: peak RSS of the process %.1f MB", stage, peak/1024.) << Endl;
+	ResetPeakMemory();
+}
+
+void TMVA::MethodNeuroBayes::ReleaseTrainingEvents()
+{
+	// LowMemory: write TMVA's training events to a spill file next to the
+	// expertise and delete them from the DataSet while the Teacher trains;
+	// ReloadTrainingEvents brings them back for the test phase. On a write
+	// error the events are kept.
+	const std::vector<Event*>& events = Data()->GetEventCollection(Types::kTraining);
+	if (events.empty()) return;
+	const TString spillFile = NBOutputFile + ".events.spill";
+	const Event* first = events[0];
+	ULong64_t header[4] = { events.size(), first->GetNVariables(), first->GetNTargets(), first->GetNSpectators() };
+	std::vector<Float_t> row(header[1] + header[2] + header[3]);
+
+	FILE* out = fopen(spillFile, "wb");
+	Bool_t ok = out != 0;
+	if (ok) ok = fwrite(kSpillMagic, sizeof(kSpillMagic), 1, out) == 1 && fwrite(header, sizeof(header), 1, out) == 1;
+	for (UInt_t ievt=0; ok && ievt<events.size(); ievt++) {
+		const Event* event = events[ievt];
+		UInt_t theClass = event->GetClass();
+		Double_t weights[2] = { event->GetOriginalWeight(), event->GetBoostWeight() };
+		for (UInt_t ivar=0; ivar<header[1]; ivar++) row[ivar] = event->GetValue(ivar);
+		std::copy(event->GetTargets().begin(), event->GetTargets().end(), row.begin() + header[1]);
+		std::copy(event->GetSpectators().begin(), event->GetSpectators().end(), row.begin() + header[1] + header[2]);
+		ok = fwrite(&theClass, sizeof(theClass), 1, out) == 1 && fwrite(weights, sizeof(weights), 1, out) == 1
+			&& (row.empty() || fwrite(&row[0], sizeof(Float_t), row.size(), out) == row.size());
+	}
+	if (out && fclose(out) != 0) ok = kFALSE;
+	if (!ok) {
+		Log() << kWARNING << "<LowMemory> : cannot write " << spillFile << ", keeping the training events in memory" << Endl;
+		gSystem->Unlink(spillFile);
+		return;
+	}
+
+	std::vector<Event*> none;
+	Data()->SetEventCollection(&none, Types::kTraining);
+#ifdef __GLIBC__
+	// hand the freed event storage back to the system
+	malloc_trim(0);
+#endif
+	fSpillFile = spillFile;
+	Log() << kINFO << "<LowMemory> : " << header[0] << " training events moved to " << spillFile << " during the training" << Endl;
+	LogMemory("releasing the training events");
+}
+
+void TMVA::MethodNeuroBayes::ReloadTrainingEvents()
+{
+	if (fSpillFile == "") return;
+	FILE* in = fopen(fSpillFile, "rb");
+	char magic[sizeof(kSpillMagic)];
+	ULong64_t header[4];
+	if (!in || fread(magic, sizeof(magic), 1, in) != 1 || memcmp(magic, kSpillMagic, sizeof(magic)) != 0 
+	    || fread(header, sizeof(header), 1, in) != 1) {
+		Log() << kFATAL << "<LowMemory> : cannot read the training events back from " << fSpillFile << Endl;
+	}
+	std::vector<Event*> events;
+	events.reserve(header[0]);
+	std::vector<Float_t> row(header[1] + header[2] + header[3]);
+	for (ULong64_t ievt=0; ievt<header[0]; ievt++) {
+		UInt_t theClass;
+		Double_t weights[2];
+		if (fread(&theClass, sizeof(theClass), 1, in) != 1 || fread(weights, sizeof(weights), 1, in) != 1
+		    || (!row.empty() && fread(&row[0], sizeof(Float_t), row.size(), in) != row.size())) {
+			Log() << kFATAL << "<LowMemory> : " << fSpillFile << " is truncated after " << ievt << " events" << Endl;
+		}
+		const std::vector<Float_t> values(row.begin(), row.begin() + header[1]);
+		const std::vector<Float_t> targets(row.begin() + header[1], row.begin() + header[1] + header[2]);
+		const std::vector<Float_t> spectators(row.begin() + header[1] + header[2], row.end());
+		events.push_back(new Event(values, targets, spectators, theClass, weights[0], weights[1]));
+	}
+	fclose(in);
+	Data()->SetEventCollection(&events, Types::kTraining);
+	gSystem->Unlink(fSpillFile);
+	Log() << kINFO << "<LowMemory> : " << events.size() << " training events reloaded for the test phase" << Endl;
+	fSpillFile = "";
+}
+
+void TMVA::MethodNeuroBayes::LoadWarmStart()
+{
+	// Reads and checks the WarmStart expertise while the options are
+	// processed, before any event is read. A weight XML has to list the
+	// variables of this booking in the same order; of a plain .nb expertise
+	// only the topology can be checked.
+	TString expertiseFile = fWarmStart;
+	const NeuroBayesExpertise* embedded = 0; // expertise embedded in the weight XML
+	if (fWarmStart.EndsWith(".xml")) {
+		TXMLEngine& xml = gTools().xmlengine();
+		XMLDocPointer_t doc = xml.ParseFile(fWarmStart.Data());
+		if (!doc) Log() << kFATAL << "WarmStart: cannot parse " << fWarmStart << Endl;
+		std::vector<TString> variables;
+		expertiseFile = "";
+		for (void* node = xml.GetChild(xml.DocGetRootElement(doc)); node; node = xml.GetNext(node)) {
+			const TString name = xml.GetNodeName(node);
+			if (name == "Variables") {
+				for (void* var = xml.GetChild(node); var; var = xml.GetNext(var)) {
+					if (TString(xml.GetNodeName(var)) == "Variable") variables.push_back(xml.GetAttr(var, "Expression"));
+				}
+			}
+			else if (name == "Weights") {
+				void* filenode = xml.GetChild(node);
+				if (filenode && xml.HasAttr(filenode, "File")) expertiseFile = xml.GetAttr(filenode, "File");
+				void* datanode = filenode ? xml.GetNext(filenode) : 0;
+				if (datanode && TString(xml.GetNodeName(datanode)) == "ExpertiseData") {
+					embedded = NeuroBayesExpertiseCache::AcquireEmbedded(xml.GetNodeContent(datanode), xml.GetAttr(datanode, "Encoding"),
+											     TString(xml.GetAttr(datanode, "Size")).Atoi());
+				}
+			}
+		}
+		xml.FreeDoc(doc);
+		if (expertiseFile == "") Log() << kFATAL << "WarmStart: " << fWarmStart << " is not the weight file of a NeuroBayes method" << Endl;
+		Bool_t compatible = variables.size() == GetNvar();
+		for (UInt_t ivar=0; compatible && ivar<GetNvar(); ivar++) {
+			compatible = variables[ivar] == DataInfo().GetVariableInfo(ivar).GetExpression();
+		}
+		if (!compatible) Log() << kFATAL << "WarmStart: the variables of " << fWarmStart << " differ from those of this booking" << Endl;
+	}
+
+	std::vector<Float_t>& expertise = fWarmStartExpertise;
+	Bool_t read;
+	if (embedded) {
+		expertise = embedded->GetData();
+		NeuroBayesExpertiseCache::Release(embedded);
+		read = kTRUE;
+	}
+	else read = NeuroBayesNativeNet::ReadExpertiseFile(expertiseFile, expertise);
+	if (!read || expertise.size() < 3) Log() << kFATAL << "WarmStart: cannot read the expertise " << expertiseFile << Endl;
+	// header NODE1 NODE2 NODE3, as set up in InitNeuroBayes
+	if (Int_t(expertise[0]) != Int_t(GetNvar()) + 1 || Int_t(expertise[1]) != Int_t(GetNvar()) + 2 || Int_t(expertise[2]) != 1) {
+		Log() << kFATAL << "WarmStart: " << expertiseFile << " has the topology " << Int_t(expertise[0]) << "-" << Int_t(expertise[1]) 
+		      << "-" << Int_t(expertise[2]) << ", this booking " << GetNvar()+1 << "-" << GetNvar()+2 << "-1" << Endl;
+	}
+	fWarmStartFile = expertiseFile;
+}
+
+void TMVA::MethodNeuroBayes::ApplyWarmStart()
+{
+	// WarmStart: once the inputs are passed, start the Teacher from the
+	// preprocessing and weights LoadWarmStart read and run only
+	// WarmStartIter iterations. ProcessOptions rejects WarmStart if the
+	// Teacher has no SetInitialExpertise.
+#ifdef NEUROBAYES_TEACHER_WARMSTART
+	if (fWarmStartExpertise.empty()) return;
+	if (!nb->SetInitialExpertise(&fWarmStartExpertise[0], fWarmStartExpertise.size())) {
+		Log() << kWARNING << "WarmStart: the Teacher does not accept " << fWarmStartFile << ", training from scratch" << Endl;
+		return;
+	}
+	// the NtrainingIter option stays as booked, e.g. in the weight file
+	Log() << kINFO << "WarmStart from " << fWarmStartFile << ": " << fWarmStartIter << " instead of " 
+	      << fNtrainingIter << " training iterations" << Endl;
+	fTrainingIter = fWarmStartIter;
+	nb->NB_DEF_ITER(fTrainingIter);
+#endif
+}
+
+void TMVA::MethodNeuroBayes::TrainTeacher( Int_t firstIter, Int_t niter, std::vector<Double_t>* losses )
+{
+	//perform training. The Teacher output is captured through a pipe and
+	//teed to nb_teacher.log; its iteration lines drive the progress bar
+	//and go to the metrics file. A continued training (firstIter > 0)
+	//appends to both files.
+	if (niter < 0) niter = fTrainingIter;
+	const Bool_t appendLog = firstIter > 0;
 	Log() << kINFO << "To see NeuroBayes output have a look at \"nb_teacher.log\"" << Endl;
-	Timer timer( 1, GetName() );
+	Timer timer( std::max(niter, 1), GetName() );
 	timer.DrawProgressBar( 0 );
-	int original = dup(fileno(stdout));
-   	fflush(stdout);
-   	freopen("nb_teacher.log", "w", stdout);
+
+	ProgressObserver progress(timer, firstIter, niter);
+	NeuroBayesTrainingMonitor monitor;
+	if (!monitor.Start("nb_teacher.log", fMetricsFile != "" ? fMetricsFile.Data() : 0, appendLog, firstIter, &progress)) {
+		Log() << kWARNING << "Cannot capture the Teacher output, training without progress information" << Endl;
+		int original = dup(fileno(stdout));
+		fflush(stdout);
+		freopen("nb_teacher.log", appendLog ? "a" : "w", stdout);
+		nb->TrainNet();
+		fflush(stdout);
+		dup2(original, fileno(stdout));
+		close(original);
+		timer.DrawProgressBar( std::max(niter, 1) );
+		return;
+	}
  	nb->TrainNet();
+	monitor.Stop();
+	timer.DrawProgressBar( std::max(niter, 1) );
+
+	const std::vector<NeuroBayesTrainingMonitor::Iteration>& iterations = monitor.GetIterations();
+	if (losses) {
+		for (UInt_t i=0; i<iterations.size(); i++) if (iterations[i].hasLoss) losses->push_back(iterations[i].loss);
+	}
+	if (iterations.empty()) {
+		Log() << kINFO << "No iteration lines recognised in the Teacher output" << Endl;
+		return;
+	}
+	Double_t wall = 0, cpu = 0;
+	for (UInt_t i=0; i<iterations.size(); i++) {
+		wall += iterations[i].wall;
+		cpu  += iterations[i].cpu;
+	}
+	Log() << kINFO << iterations.size() << " iterations in " << wall << " s, per iteration " 
+	      << wall/iterations.size() << " s wall and " << cpu/iterations.size() << " s CPU";
+	if (iterations.back().hasLoss) Log() << ", last loss " << iterations.back().loss;
+	Log() << Endl;
+	if (fDownsampleSpeedup > 1) {
+		Log() << kINFO << Form("Downsampling saved about %.1f s of training (%.1fx speedup)",
+				       wall*(fDownsampleSpeedup - 1), fDownsampleSpeedup) << Endl;
+	}
+	if (fMetricsFile != "") Log() << kINFO << "Training metrics written to " << fMetricsFile << Endl;
+}
+
+void TMVA::MethodNeuroBayes::TrainWithEarlyStopping()
+{
+	// The Teacher does not report a loss per iteration, so it is trained in
+	// chunks of EarlyStoppingChunk iterations, each continuing from the net
+	// of the previous one. After every chunk the expertise is scored on the
+	// validation events and the best one so far is kept.
+	//
+	// That the Teacher continues rather than starting over is checked on
+	// its printed training loss: the first iteration of a chunk may not be
+	// worse than the last one of the chunk before (up to the fluctuation
+	// of the stochastic weight updates). If it is, or if the Teacher prints
+	// no loss, the chunks are worthless and the net is trained once with
+	// all iterations instead.
+	const Double_t continuationTolerance = 0.01;
+	const TString expertise = NBOutputFile + ".nb";
+	const TString bestExpertise = NBOutputFile + ".best.nb";
+	Double_t bestLoss = -1;
+	Int_t bestIter = 0, iter = 0, checksWithoutGain = 0;
+	Bool_t continued = kTRUE;
+	std::vector<Double_t> previousLosses;
+	while (iter < fTrainingIter) {
+		const Int_t chunk = std::min(std::max(fEarlyStoppingChunk, 1), fTrainingIter - iter);
+		std::vector<Double_t> losses;
+		nb->NB_DEF_ITER(chunk);
+		TrainTeacher(iter, chunk, &losses);
+		if (losses.empty()) {
+			Log() << kWARNING << "No training loss in the Teacher output, cannot verify that it continues between "
+			      << "chunks. Stopping EarlyStopping and training once with " << fTrainingIter << " iterations" << Endl;
+			continued = kFALSE;
+			break;
+		}
+		if (iter > 0 && losses.front() > previousLosses.back()*(1 + continuationTolerance)) {
+			Log() << kWARNING << "Training loss went from " << previousLosses.back() << " to " << losses.front() 
+			      << " between chunks, the Teacher does not continue its training. Stopping EarlyStopping and "
+			      << "training once with " << fTrainingIter << " iterations" << Endl;
+			continued = kFALSE;
+			break;
+		}
+		previousLosses.swap(losses);
+		iter += chunk;
+
+		const Double_t loss = GetValidationLoss(expertise);
+		Log() << kINFO << "Iteration " << iter << ": validation loss " << loss << Endl;
+		if (bestLoss < 0 || loss < bestLoss) {
+			bestLoss = loss;
+			bestIter = iter;
+			checksWithoutGain = 0;
+			gSystem->CopyFile(expertise, bestExpertise, kTRUE);
+		}
+		else if (++checksWithoutGain >= fPatience) {
+			Log() << kINFO << "No improvement for " << fPatience << " checks, stopping after " << iter 
+			      << " of " << fTrainingIter << " iterations" << Endl;
+			break;
+		}
+	}
+	nb->NB_DEF_ITER(fTrainingIter);
+	ClearValidationSample();
+	if (continued) {
+		Log() << kINFO << "Keeping the expertise of iteration " << bestIter << " (validation loss " << bestLoss << ")" << Endl;
+		gSystem->CopyFile(bestExpertise, expertise, kTRUE);
+	}
+	// the Teacher starts from scratch, so this is a complete training
+	else TrainTeacher();
+	gSystem->Unlink(bestExpertise);
+}
 
+Double_t TMVA::MethodNeuroBayes::GetValidationLoss( const TString& expertiseFile )
+{
+	// weighted cross entropy of the nb_expert response on fValidationSample
+	Expert* expert = NeuroBayesExpertiseCache::NewExpert(0, expertiseFile.Data());
+	const UInt_t nvar = GetNvar();
+	std::vector<Double_t> row(nvar);
+	const Double_t eps = 1.e-7;
+	Double_t loss = 0, sumw = 0;
+	for (UInt_t ievt=0; ievt<fValidationSample.size(); ievt++) {
+		const Event* event = fValidationSample[ievt];
+		for (UInt_t ivar=0; ivar<nvar; ivar++) row[ivar] = event->GetValue(ivar);
+		const Double_t p = std::min(std::max(0.5*(expert->nb_expert(&row[0]) + 1), eps), 1 - eps);
+		const Double_t w = event->GetWeight();
+		loss -= w*(DataInfo().IsSignal(event) ? std::log(p) : std::log(1 - p));
+		sumw += w;
+	}
+	delete expert;
+	return sumw > 0 ? loss/sumw : 0;
+}
+
+void TMVA::MethodNeuroBayes::ResetInputStatistics()
+{
+	if (!fInputStats) fInputStats = new NeuroBayesInputStatistics(GetNvar());
+	else fInputStats->Reset(GetNvar());
+}
+
+void TMVA::MethodNeuroBayes::ClearValidationSample()
+{
+	for (UInt_t ievt=0; ievt<fValidationSample.size(); ievt++) delete fValidationSample[ievt];
+	fValidationSample.clear();
+}
+
+void TMVA::MethodNeuroBayes::TrainIsolated()
+{
+	// Waiting also starts the queued workers of the other bookings, so up
+	// to TrainingWorkers trainings run at the same time
+	Log() << kINFO << "Training in a worker process, up to " << TrainingPool().GetMaxWorkers() 
+	      << " NeuroBayes trainings run concurrently" << Endl;
+	Int_t status = TrainingPool().Wait(fTrainingJob);
+	if (TrainingPool().ForkFailed(fTrainingJob)) {
+		Log() << kWARNING << "Cannot fork a worker for " << GetMethodName() << ", training in this process" << Endl;
+		fTrainingJob = -1;
+		ConfigureTeacher();
+		TrainInProcess();
+		return;
+	}
+	TString workdir = NBOutputFile + ".work";
+	Log() << kINFO << "Worker of " << GetMethodName() << " finished after " << TrainingPool().GetWallTime(fTrainingJob) 
+	      << " s, Teacher output is in " << workdir << Endl;
+	if (status != 0) Log() << kFATAL << "Isolated training of " << GetMethodName() << " failed with status " 
+	                       << status << ", see " << workdir << "/worker.log" << Endl;
+
+	ResetInputStatistics();
+	if (!fInputStats->Read(NBOutputFile + ".stats"))
+		Log() << kWARNING << "No input statistics from the worker, the variable ranking is not available" << Endl;
+	SetupExpert(NBOutputFile + ".nb");
+}
+
+Bool_t TMVA::MethodNeuroBayes::InitWorker( const TString& suffix )
+{
+	// Sets up the Teacher in a forked worker process, which has a Teacher
+	// singleton of its own. The expertise is written to NBOutputFile+suffix;
+	// the teacher log, ahist.txt and the analysis files go to a private
+	// working directory, so concurrent workers do not overwrite each other.
+	InitNeuroBayes(fTask);
+	if (!gSystem->IsAbsoluteFileName(NBOutputFile)) NBOutputFile = TString(gSystem->WorkingDirectory()) + "/" + NBOutputFile;
+	NBOutputFile += suffix;
+	nb->SetOutputFile(NBOutputFile + ".nb");
+
+	TString workdir = NBOutputFile + ".work";
+	gSystem->mkdir(workdir, kTRUE);
+	if (!gSystem->ChangeDirectory(workdir)) return kFALSE;
 	fflush(stdout);
-   	dup2(original, fileno(stdout));
-   	close(original);
-	timer.DrawProgressBar( 1 );
+	if (!freopen("worker.log", "w", stdout)) return kFALSE;
+	dup2(fileno(stdout), fileno(stderr));
+	return kTRUE;
+}
 
+Int_t TMVA::MethodNeuroBayes::TrainInWorker()
+{
+	if (!InitWorker("")) return 1;
+
+	// this booking may not have reached its own TrainMethod() yet
+	Data()->SetCurrentType(Types::kTraining);
+	GetTransformationHandler().CalcTransformations(Data()->GetEventCollection());
+
+	ConfigureTeacher();
+	IngestTrainingEvents();
+	// for the variable ranking in the parent process
+	fInputStats->Write(NBOutputFile + ".stats");
+	ApplyWarmStart();
+	if (fEarlyStopping) TrainWithEarlyStopping();
+	else TrainTeacher();
 	if(frunAnalysis) {
 		runAnalysis();
 	}
-	//Setup Expert, it might be needed...
-	Net = new Expert(TString(NBOutputFile + ".nb").Data());
+	return gSystem->AccessPathName(NBOutputFile + ".nb") ? 2 : 0;
+}
+
+void TMVA::MethodNeuroBayes::TrainScan()
+{
+	// The training inputs are extracted once; the forked candidate workers
+	// share them copy-on-write, train on all but the held-out events and
+	// rank themselves on the held-out events
+	delete fSample;
+	fSample = new NeuroBayesSample(GetNvar());
+	LoadSample(*fSample);
+	ResetInputStatistics();
+	for (Long64_t ievt=0; ievt<fSample->GetNEvents(); ievt++) {
+		fInputStats->Fill(fSample->GetInputs(ievt), fSample->GetTarget(ievt), fSample->GetWeight(ievt));
+	}
+
+	NeuroBayesProcessPool pool(fTrainingWorkers);
+	std::vector<Int_t> jobs;
+	for (UInt_t icand=0; icand<fScanCandidates.size(); icand++) {
+		jobs.push_back(pool.Submit(new ScanCandidateJob(this, icand)));
+	}
+	Log() << kINFO << "Scanning " << fScanCandidates.size() << " NeuroBayes configurations, " 
+	      << 100*fScanHoldout << "% of the events held out, up to " << pool.GetMaxWorkers() << " at a time" << Endl;
+	if (frunAnalysis) Log() << kINFO << "The NeuroBayes analysis is not run in Scan mode" << Endl;
+
+	std::vector<ScanResult> results(fScanCandidates.size());
+	for (UInt_t icand=0; icand<fScanCandidates.size(); icand++) {
+		ScanResult& result = results[icand];
+		result.candidate = icand;
+		result.status    = pool.Wait(jobs[icand]);
+		result.walltime  = pool.GetWallTime(jobs[icand]);
+		result.roc  = 0;
+		result.loss = 0;
+		if (pool.ForkFailed(jobs[icand])) Log() << kWARNING << "Cannot fork a worker for Scan candidate " << icand << ", it is not trained" << Endl;
+		std::ifstream in(TString(NBOutputFile + Form(".scan%d.work/scan_result.txt", icand)).Data());
+		if (result.status == 0 && !(in >> result.roc >> result.loss)) result.status = 3;
+	}
+	std::sort(results.begin(), results.end(), BetterScanResult);
+
+	TString summaryFile = NBOutputFile + ".scan.txt";
+	std::ofstream summary(summaryFile.Data());
+	summary << "# NeuroBayes scan of " << GetMethodName() << ", ranked by held-out ROC integral" << std::endl;
+	summary << "# rank candidate status roc_integral entropy_loss walltime[s] settings" << std::endl;
+	Log() << kINFO << "rank candidate  ROC-integral  entropy-loss  walltime[s]  settings" << Endl;
+	for (UInt_t irank=0; irank<results.size(); irank++) {
+		const ScanResult& result = results[irank];
+		summary << irank+1 << " " << result.candidate << " " << result.status << " " << result.roc << " " 
+		        << result.loss << " " << result.walltime << " " << fScanCandidates[result.candidate] << std::endl;
+		Log() << kINFO << Form("%4d %9d  %12.5f  %12.5f  %11.1f  ", irank+1, result.candidate, result.roc, result.loss, result.walltime)
+		      << fScanCandidates[result.candidate] << (result.status != 0 ? " (failed)" : "") << Endl;
+	}
+	summary.close();
+	Log() << kINFO << "Scan summary written to " << summaryFile << Endl;
+
+	if (results.empty() || results[0].status != 0) Log() << kFATAL << "No Scan candidate was trained successfully" << Endl;
+
+	// keep the best expertise; the options written to the weight file
+	// then describe the configuration it was trained with
+	const UInt_t best = results[0].candidate;
+	gSystem->CopyFile(NBOutputFile + Form(".scan%d.nb", best), NBOutputFile + ".nb", kTRUE);
+	ApplyScanCandidate(fScanCandidates[best]);
+	Log() << kINFO << "Best configuration: " << fScanCandidates[best] << Endl;
+
+	delete fSample;
+	fSample = NULL;
+	SetupExpert(NBOutputFile + ".nb");
+}
+
+Int_t TMVA::MethodNeuroBayes::TrainScanCandidate( UInt_t icand )
+{
+	ApplyScanCandidate(fScanCandidates[icand]);
+	if (!InitWorker(Form(".scan%d", icand))) return 1;
+	Log() << kINFO << "Scan candidate " << icand << ": " << fScanCandidates[icand] << Endl;
+	ConfigureTeacher();
+
+	std::vector<Char_t> trainMask(fSample->GetNEvents());
+	std::vector<Long64_t> holdout;
+	for (Long64_t ievt=0; ievt<fSample->GetNEvents(); ievt++) {
+		trainMask[ievt] = !NeuroBayesSample::InFraction(ievt, fScanHoldout);
+		if (!trainMask[ievt]) holdout.push_back(ievt);
+	}
+	FeedTeacher(*fSample, &trainMask);
+	TrainTeacher();
+	if (gSystem->AccessPathName(NBOutputFile + ".nb")) return 2;
+
+	std::vector<Double_t> responses;
+	ScoreExpertise(NBOutputFile + ".nb", *fSample, holdout, responses);
+	std::ofstream result("scan_result.txt");
+	result << fSample->GetROCIntegral(holdout, responses) << " " << fSample->GetEntropyLoss(holdout, responses) << std::endl;
+	return result.good() ? 0 : 3;
+}
+
+void TMVA::MethodNeuroBayes::TrainKFolds()
+{
+	// The training inputs are extracted once and shared copy-on-write by
+	// the fold workers. Fold 0 becomes the expertise of the method, the
+	// weight file lists the others.
+	delete fSample;
+	fSample = new NeuroBayesSample(GetNvar());
+	LoadSample(*fSample);
+	ResetInputStatistics();
+	for (Long64_t ievt=0; ievt<fSample->GetNEvents(); ievt++) {
+		fInputStats->Fill(fSample->GetInputs(ievt), fSample->GetTarget(ievt), fSample->GetWeight(ievt));
+	}
+
+	NeuroBayesProcessPool pool(fTrainingWorkers);
+	std::vector<Int_t> jobs;
+	for (Int_t ifold=0; ifold<fKFolds; ifold++) jobs.push_back(pool.Submit(new FoldJob(this, ifold)));
+	Log() << kINFO << "Training " << fKFolds << " folds, up to " << pool.GetMaxWorkers() << " at a time" << Endl;
+	if (frunAnalysis) Log() << kINFO << "The NeuroBayes analysis is not run with KFolds" << Endl;
+
+	std::vector<TString> foldFiles;
+	for (Int_t ifold=0; ifold<fKFolds; ifold++) {
+		const Int_t status = pool.Wait(jobs[ifold]);
+		const TString prefix = NBOutputFile + Form(".fold%d", ifold);
+		// the folds share the Teacher singleton, they cannot train in this process
+		if (pool.ForkFailed(jobs[ifold])) Log() << kFATAL << "Cannot fork a worker for fold " << ifold << Endl;
+		Log() << kINFO << "Fold " << ifold << " finished after " << pool.GetWallTime(jobs[ifold]) << " s" << Endl;
+		if (status != 0) Log() << kFATAL << "Fold " << ifold << " failed with status " << status 
+				       << ", see " << prefix << ".work/worker.log" << Endl;
+		if (ifold > 0) foldFiles.push_back(prefix + ".nb");
+	}
+	delete fSample;
+	fSample = NULL;
+
+	gSystem->CopyFile(NBOutputFile + ".fold0.nb", NBOutputFile + ".nb", kTRUE);
+	SetupExpert(NBOutputFile + ".nb", 0, foldFiles);
+
+	// the test phase of this job gets the out-of-fold response for the
+	// training events, see GetFoldEvent
+	fFoldsTrainedHere = kTRUE;
+	fFoldEventIndex.clear();
+	fFoldEventHint = -1;
+}
+
+Int_t TMVA::MethodNeuroBayes::TrainFold( UInt_t ifold )
+{
+	if (!InitWorker(Form(".fold%d", ifold))) return 1;
+	ConfigureTeacher();
+	std::vector<Char_t> trainMask(fSample->GetNEvents());
+	for (Long64_t ievt=0; ievt<fSample->GetNEvents(); ievt++) trainMask[ievt] = (ievt % fKFolds != ifold);
+	FeedTeacher(*fSample, &trainMask);
+	ApplyWarmStart();
+	TrainTeacher();
+	return gSystem->AccessPathName(NBOutputFile + ".nb") ? 2 : 0;
+}
+
+void TMVA::MethodNeuroBayes::BuildScanCandidates()
+{
+	// Scan spec: comma separated Name{v1|v2|...} lists or Name{lo~hi}
+	// ranges; the grid is the cartesian product of the lists, the random
+	// search (ScanSamples>0) draws every parameter uniformly
+	if (fScanHoldout <= 0 || fScanHoldout >= 1) Log() << kFATAL << "ScanHoldout has to be between 0 and 1" << Endl;
+
+	std::vector<TString> names;
+	std::vector< std::vector<TString> > values;
+	std::vector<Double_t> rangeLow, rangeHigh;
+	TObjArray* items = fScan.Tokenize(",");
+	for (Int_t item=0; item<items->GetEntriesFast(); item++) {
+		TString spec = ((TObjString *)items->At(item))->GetString();
+		Ssiz_t open = spec.Index("{");
+		if (open <= 0 || !spec.EndsWith("}")) Log() << kFATAL << "Cannot parse Scan entry \"" << spec << "\"" << Endl;
+		TString name = spec(0, open);
+		TString body = spec(open+1, spec.Length()-open-2);
+		if (!ApplyScanSetting(name, "")) Log() << kFATAL << "Parameter " << name << " cannot be scanned" << Endl;
+
+		names.push_back(name);
+		values.push_back(std::vector<TString>());
+		rangeLow.push_back(0);
+		rangeHigh.push_back(0);
+		if (body.Contains("~")) {
+			if (fScanSamples <= 0) Log() << kFATAL << "Range " << spec << " needs random search, set ScanSamples" << Endl;
+			rangeLow.back()  = TString(body(0, body.Index("~"))).Atof();
+			rangeHigh.back() = TString(body(body.Index("~")+1, body.Length())).Atof();
+			continue;
+		}
+		TObjArray* choices = body.Tokenize("|");
+		for (Int_t i=0; i<choices->GetEntriesFast(); i++) values.back().push_back(((TObjString *)choices->At(i))->GetString());
+		delete choices;
+		if (values.back().empty()) Log() << kFATAL << "No values given for " << name << Endl;
+	}
+	delete items;
+
+	fScanCandidates.clear();
+	if (fScanSamples > 0) {
+		TRandom3 random(4711);
+		for (Int_t icand=0; icand<fScanSamples; icand++) {
+			TString settings;
+			for (UInt_t ipar=0; ipar<names.size(); ipar++) {
+				TString value;
+				if (values[ipar].empty()) {
+					Double_t x = random.Uniform(rangeLow[ipar], rangeHigh[ipar]);
+					value = (names[ipar] == "WeightUpdate" || names[ipar] == "Preprocessing") ? Form("%d", Int_t(x + 0.5)) : Form("%g", x);
+				}
+				else value = values[ipar][random.Integer(values[ipar].size())];
+				settings += (ipar ? "," : "") + names[ipar] + "=" + value;
+			}
+			fScanCandidates.push_back(settings);
+		}
+	}
+	else {
+		// odometer over all value lists
+		std::vector<UInt_t> index(names.size(), 0);
+		for (Bool_t done = names.empty(); !done; ) {
+			TString settings;
+			for (UInt_t ipar=0; ipar<names.size(); ipar++) settings += (ipar ? "," : "") + names[ipar] + "=" + values[ipar][index[ipar]];
+			fScanCandidates.push_back(settings);
+			done = kTRUE;
+			for (UInt_t ipar=0; ipar<names.size() && done; ipar++) {
+				if (++index[ipar] < values[ipar].size()) done = kFALSE;
+				else index[ipar] = 0;
+			}
+		}
+	}
+	Log() << kINFO << "Scan has " << fScanCandidates.size() << " candidates" << Endl;
+}
+
+void TMVA::MethodNeuroBayes::ApplyScanCandidate( const TString& settings )
+{
+	TObjArray* pairs = settings.Tokenize(",");
+	for (Int_t i=0; i<pairs->GetEntriesFast(); i++) {
+		TString pair = ((TObjString *)pairs->At(i))->GetString();
+		ApplyScanSetting(pair(0, pair.Index("=")), pair(pair.Index("=")+1, pair.Length()));
+	}
+	delete pairs;
+}
+
+Bool_t TMVA::MethodNeuroBayes::ApplyScanSetting( const TString& name, const TString& value )
+{
+	// an empty value only checks whether the parameter can be scanned
+	Bool_t check = (value == "");
+	if      (name == "Regularisation") { if (!check) fRegularisation = value; }
+	else if (name == "Preprocessing")  { if (!check) fPreprocessing  = value.Atoi(); }
+	else if (name == "Momentum")       { if (!check) fMomentum       = value.Atof(); }
+	else if (name == "LearningSpeed")  { if (!check) fLearningSpeed  = value.Atof(); }
+	else if (name == "WeightUpdate")   { if (!check) fWeightUpdate   = value.Atoi(); }
+	else if (name == "TrainingMethod") { if (!check) fTrainingMethod = value; }
+	else return kFALSE;
+	return kTRUE;
 }
 
 // write weights to file
@@ -258,11 +1742,35 @@ void TMVA::MethodNeuroBayes::WriteWeightsToStream( ostream& o )const {
 }
 
 void TMVA::MethodNeuroBayes::AddWeightsXMLTo(void* parent) const {
+	AnalysisPool().Poll();
 	void* expertise = gTools().xmlengine().NewChild(parent, 0, "Weights");
 	gTools().AddAttr(expertise, "NVariables", GetNvar());
 	void* filenode = gTools().xmlengine().NewChild(expertise, 0, "Expertise");
 
 	gTools().AddAttr(filenode, "File", NBOutputFile + ".nb");
+
+	if (fEmbedExpertise) {
+		std::ifstream in(TString(NBOutputFile + ".nb").Data(), std::ios::binary);
+		std::string raw((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		if (raw.empty()) {
+			Log() << kWARNING << "Cannot embed " << NBOutputFile << ".nb, the weight file only refers to it" << Endl;
+		}
+		else {
+			TString encoding;
+			TString content = EncodeExpertise(raw, encoding);
+			void* datanode = gTools().xmlengine().NewChild(expertise, 0, "ExpertiseData", content);
+			gTools().AddAttr(datanode, "Encoding", encoding);
+			gTools().AddAttr(datanode, "Size", Int_t(raw.size()));
+		}
+	}
+
+	// KFolds: the expertise above is fold 0, the other folds follow
+	if (fEmbedExpertise && !fFoldFiles.empty()) 
+		Log() << kWARNING << "Only fold 0 is embedded, the weight file refers to the other folds" << Endl;
+	for (UInt_t i=0; i<fFoldFiles.size(); i++) {
+		void* foldnode = gTools().xmlengine().NewChild(expertise, 0, "FoldExpertise");
+		gTools().AddAttr(foldnode, "File", fFoldFiles[i]);
+	}
 }
 
 //Is abused to setup the Expert
@@ -274,19 +1782,50 @@ void TMVA::MethodNeuroBayes::ReadWeightsFromStream( istream& istr ){
 	Log() << kINFO << "Setting up NB Expert" << Endl;
 	if(filename.CompareTo("noFile.nb") == 0) Log() << kWARNING << GetMethodName() << 
 		" is not trained because it was not the first booked NeuroBayesTeacher. Please repeat training." << Endl;
-	else Net = new Expert(filename);
+	else SetupExpert(filename);
 	Log() << kINFO << "Set up NB Expert done" << Endl;
 }
 
 void TMVA::MethodNeuroBayes::ReadWeightsFromXML(void* weightnode){
+	InitProfiler();
+	const Long64_t start = fProfiler ? NeuroBayesProfiler::Now() : 0;
 	Log() << kINFO << "Setting up NB Expert" << Endl;
 	TString expertiseFile;
 	void* filenode = gTools().xmlengine().GetChild(weightnode);
 	gTools().ReadAttr(filenode, "File",expertiseFile);
-	Log() << kINFO << "Setting up NB Expert " << expertiseFile << Endl;
-	if(expertiseFile.CompareTo("noFile.nb") == 0) Log() << kWARNING << GetMethodName() << 
-		" is not trained because it was not the first booked NeuroBayesTeacher. Please repeat training." << Endl;
-	else Net = new Expert(expertiseFile.Data());
+
+	// a KFolds ensemble lists the expertises of folds 1..KFolds-1
+	std::vector<TString> foldFiles;
+	for (void* node = gTools().xmlengine().GetNext(filenode); node; node = gTools().xmlengine().GetNext(node)) {
+		if (TString(gTools().xmlengine().GetNodeName(node)) != "FoldExpertise") continue;
+		TString foldFile;
+		gTools().ReadAttr(node, "File", foldFile);
+		foldFiles.push_back(foldFile);
+	}
+
+	// an embedded expertise needs no access to the .nb file
+	void* datanode = gTools().xmlengine().GetNext(filenode);
+	if (datanode && TString(gTools().xmlengine().GetNodeName(datanode)) == "ExpertiseData") {
+		TString encoding;
+		Int_t size = 0;
+		gTools().ReadAttr(datanode, "Encoding", encoding);
+		gTools().ReadAttr(datanode, "Size", size);
+		const NeuroBayesExpertise* expertise = 
+			NeuroBayesExpertiseCache::AcquireEmbedded(gTools().xmlengine().GetNodeContent(datanode), encoding, size);
+		if (expertise) {
+			Log() << kINFO << "Setting up NB Expert from the expertise embedded in the weight file" << Endl;
+			SetupExpert(expertiseFile, expertise, foldFiles);
+		}
+		else Log() << kWARNING << "Embedded expertise is corrupt, falling back to " << expertiseFile << Endl;
+	}
+
+	if (fExpertState == kExpertNone) {
+		Log() << kINFO << "Setting up NB Expert " << expertiseFile << Endl;
+		if(expertiseFile.CompareTo("noFile.nb") == 0) Log() << kWARNING << GetMethodName() << 
+			" is not trained because it was not the first booked NeuroBayesTeacher. Please repeat training." << Endl;
+		else SetupExpert(expertiseFile, 0, foldFiles);
+	}
+	if (fProfiler) fProfiler->Fill(0, NeuroBayesProfiler::kReadWeights, NeuroBayesProfiler::Now() - start);
 	Log() << kINFO << "Set up NB Expert done" << Endl;
 }
 
@@ -296,9 +1835,25 @@ void TMVA::MethodNeuroBayes::GetHelpMessage()const {
 
 // ranking of input variables
 const TMVA::Ranking* TMVA::MethodNeuroBayes::CreateRanking(){
-	//Give a ranking of InputVariables back, descending in importance for classification	
-	//Not working
-	return 0;
+	//Give a ranking of InputVariables back, descending in importance for classification.
+	//Uses the statistics collected while the Teacher was fed: the importance
+	//is the significance (sqrt of the effective number of events times the
+	//correlation) lost when the variable is removed, least important first.
+	std::vector<Double_t> loss;
+	Double_t total = 0;
+	if (!fInputStats || !fInputStats->GetCorrelationLoss(total, loss)) {
+		Log() << kWARNING << "No input statistics, variables can only be ranked after training in this job" << Endl;
+		return 0;
+	}
+
+	const Double_t neff = fInputStats->GetEffectiveEvents();
+	Log() << kINFO << "Total correlation to the target " << std::sqrt(std::max(total, 0.)) 
+	      << ", significance " << std::sqrt(std::max(total, 0.)*neff) << " sigma" << Endl;
+	fRanking = new Ranking(GetName(), "Importance");
+	for (UInt_t ivar=0; ivar<GetNvar(); ivar++) {
+		fRanking->AddRank(Rank(GetInputLabel(ivar), std::sqrt(std::max(loss[ivar], 0.)*neff)));
+	}
+	return fRanking;
 }
 
 #if ROOT_VERSION_CODE >= ROOT_VERSION(5,28,0)
@@ -307,17 +1862,493 @@ Double_t TMVA::MethodNeuroBayes::GetMvaValue( Double_t* errLower, Double_t* errU
 Double_t TMVA::MethodNeuroBayes::GetMvaValue( Double_t* errLower)
 #endif
 {
+	 const Long64_t start = fProfiler ? NeuroBayesProfiler::Now() : 0;
 	 Double_t myMVA = 0;
-	 Double_t var[GetNvar()];
+	 const UInt_t nvar = GetNvar();
+	 fInputBuffer.resize(nvar);
 	 const Event* ev = Data()->GetEvent();
-	 for (UInt_t ivar=0; ivar<GetNvar(); ivar++) {
-	 	var[ivar] = ev->GetValue(ivar);
+	 for (UInt_t ivar=0; ivar<nvar; ivar++) {
+	 	fInputBuffer[ivar] = ev->GetValue(ivar);
 	 }
+	 if (fProfiler) fProfiler->Fill(0, NeuroBayesProfiler::kGather, NeuroBayesProfiler::Now() - start);
 
-	 myMVA = Net->nb_expert(var);
+	 if (!fFoldFiles.empty()) {
+		 const Long64_t ievt = GetFoldEvent();
+		 EvaluateFolds(&fInputBuffer[0], 1, ievt >= 0 ? &ievt : 0, &myMVA);
+	 }
+	 else EvaluateBatch(&fInputBuffer[0], 1, &myMVA);
+	 if (fProfiler) fProfiler->Fill(0, NeuroBayesProfiler::kGetMvaValue, NeuroBayesProfiler::Now() - start);
 	 return myMVA;
 }
 
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,8,0)
+std::vector<Double_t> TMVA::MethodNeuroBayes::GetMvaValues( Long64_t firstEvt, Long64_t lastEvt, Bool_t logProgress )
+{
+	// Batched replacement of MethodBase::GetMvaValues: the inputs of up to
+	// fgBatchSize events are gathered into one reusable buffer and the whole
+	// block is scored in a single EvaluateBatch call
+	// a background analysis report that has finished by now ends here
+	AnalysisPool().Poll();
+	Long64_t nEvents = Data()->GetNEvents();
+	if (firstEvt > lastEvt || lastEvt > nEvents) lastEvt = nEvents;
+	if (firstEvt < 0) firstEvt = 0;
+	std::vector<Double_t> values(lastEvt-firstEvt);
+	nEvents = values.size();
+
+	Timer timer( nEvents, GetName(), kTRUE );
+	if (logProgress)
+		Log() << kINFO << "Evaluation of " << GetMethodName() << " on "
+		      << (Data()->GetCurrentType() == Types::kTraining ? "training" : "testing")
+		      << " sample (" << nEvents << " events)" << Endl;
+
+	// with several scoring threads every thread gets a full block
+	const Long64_t batchSize = fgBatchSize*std::max(fNThreads, 1);
+	const UInt_t nvar = GetNvar();
+	fInputBuffer.resize(batchSize*nvar);
+	for (Long64_t first=firstEvt; first<lastEvt; first+=batchSize) {
+		const Long64_t nblock = std::min(batchSize, lastEvt-first);
+		const Long64_t start = fProfiler ? NeuroBayesProfiler::Now() : 0;
+		Double_t* row = &fInputBuffer[0];
+		for (Long64_t ievt=first; ievt<first+nblock; ievt++, row+=nvar) {
+			const Event* ev = Data()->GetEvent(ievt);
+			for (UInt_t ivar=0; ivar<nvar; ivar++) row[ivar] = ev->GetValue(ivar);
+		}
+		if (fProfiler) fProfiler->Fill(0, NeuroBayesProfiler::kGather, (NeuroBayesProfiler::Now() - start)/nblock, nblock);
+		if (!fFoldFiles.empty()) {
+			// the folds trained in this job know which training events they saw
+			std::vector<Long64_t> events;
+			if (fFoldsTrainedHere && Data()->GetCurrentType() == Types::kTraining) {
+				for (Long64_t ievt=first; ievt<first+nblock; ievt++) events.push_back(ievt);
+			}
+			EvaluateFolds(&fInputBuffer[0], nblock, events.empty() ? 0 : &events[0], &values[first-firstEvt]);
+		}
+		else EvaluateBatch(&fInputBuffer[0], nblock, &values[first-firstEvt]);
+		if (logProgress) timer.DrawProgressBar( Int_t(first-firstEvt+nblock) );
+	}
+
+	if (logProgress)
+		Log() << kINFO << "Elapsed time for evaluation of " << nEvents << " events: "
+		      << timer.GetElapsedTime() << Endl;
+	return values;
+}
+#endif
+
+void TMVA::MethodNeuroBayes::EvaluateBatch( const Double_t* inputs, Long64_t nevents, Double_t* values )
+{
+	// Expert::nb_expert takes a non-const row but does not modify it
+	if (fExpertState != kExpertReady) WaitForExpert();
+	const UInt_t nvar = GetNvar();
+	if (fProfiler) {
+		const Long64_t start = NeuroBayesProfiler::Now();
+		std::vector<Expert*> nets(1, Net);
+		UInt_t nslots = 1;
+		if (fNThreads > 1 && nevents >= 2*fgMinEventsPerThread) {
+			SetupThreadPool();
+			nets.insert(nets.end(), fWorkerNets.begin(), fWorkerNets.end());
+			nslots = fThreadPool->GetNThreads();
+		}
+		fProfiler->SetNSlots(nslots);
+		ScoreSliceTask task(nets, fNative, fQuantized, inputs, nevents, nvar, values, fProfiler);
+		if (nslots > 1) fThreadPool->Run(&task);
+		else task.Run(0, 1);
+		fProfiler->Fill(0, NeuroBayesProfiler::kBatch, NeuroBayesProfiler::Now() - start);
+		return;
+	}
+	if (fNThreads > 1 && nevents >= 2*fgMinEventsPerThread) {
+		SetupThreadPool();
+		std::vector<Expert*> nets(1, Net);
+		nets.insert(nets.end(), fWorkerNets.begin(), fWorkerNets.end());
+		ScoreSliceTask task(nets, fNative, fQuantized, inputs, nevents, nvar, values);
+		fThreadPool->Run(&task);
+		return;
+	}
+	if (fQuantized) {
+		fQuantized->Evaluate(inputs, nevents, values);
+		return;
+	}
+	if (fNative) {
+		fNative->Evaluate(inputs, nevents, values);
+		return;
+	}
+
+	Double_t* row = const_cast<Double_t*>(inputs);
+	for (Long64_t ievt=0; ievt<nevents; ievt++, row+=nvar) {
+		values[ievt] = Net->nb_expert(row);
+	}
+}
+
+void TMVA::MethodNeuroBayes::SetupExpert( const TString& expertiseFile, const NeuroBayesExpertise* expertise,
+					  const std::vector<TString>& foldFiles )
+{
+	// (re)create the Expert from the file or, if given, from the expertise
+	// contents; scoring threads of an older expertise are dropped. Instances
+	// set up from the same expertise share its contents and native network
+	// through NeuroBayesExpertiseCache, only the Experts are per instance.
+	//
+	// With ExpertLoading=Lazy the Expert is created at the first
+	// evaluation, with Background on a thread started here; evaluations
+	// call WaitForExpert, which only waits if the loading is not done.
+	// The further folds of a KFolds ensemble are loaded along with it.
+	ClearExpert();
+	fExpertiseFile = expertiseFile;
+	fExpertise = expertise;
+	fFoldFiles = foldFiles;
+	if (fInferenceBackend != "Native" && fNativePrecision != "Float") 
+		Log() << kWARNING << "NativePrecision=" << fNativePrecision << " requires InferenceBackend=Native, ignored" << Endl;
+
+	fExpertMode = GetExpertLoading();
+	fExpertState = kExpertDeferred;
+	if (fExpertMode == "Background") {
+		fExpertLoader = new NeuroBayesExpertLoader(this);
+		if (fExpertLoader->Start()) fExpertState = kExpertLoading;
+		else {
+			Log() << kWARNING << "Cannot start a thread to load the Expert, loading it at the first evaluation" << Endl;
+			delete fExpertLoader;
+			fExpertLoader = NULL;
+		}
+	}
+	if (fExpertMode == "Eager") WaitForExpert();
+}
+
+TString TMVA::MethodNeuroBayes::GetExpertLoading()
+{
+	// NEUROBAYES_EXPERT_LOADING overrides the option stored with the weights
+	const char* env = gSystem->Getenv("NEUROBAYES_EXPERT_LOADING");
+	if (!env || TString(env) == "") return fExpertLoading;
+	const TString mode = env;
+	if (mode == "Eager" || mode == "Lazy" || mode == "Background") return mode;
+	Log() << kWARNING << "NEUROBAYES_EXPERT_LOADING=" << mode << " is not one of Eager, Lazy, Background; ignored" << Endl;
+	return fExpertLoading;
+}
+
+void TMVA::MethodNeuroBayes::LoadExpert()
+{
+	// the part of the Expert setup that may run on the loading thread:
+	// no logging and no access to the DataSet
+	const Double_t start = Now();
+	if (!fExpertise) fExpertise = NeuroBayesExpertiseCache::Acquire(fExpertiseFile.Data());
+	Net = CreateExpert(fCreateExpertTime);
+	if (fInferenceBackend == "Native" && fExpertise) NeuroBayesExpertiseCache::GetNativeNet(fExpertise);
+	LoadFolds();
+	fExpertLoadTime = Now() - start;
+}
+
+void TMVA::MethodNeuroBayes::WaitForExpert()
+{
+	// completes a deferred or background setup, in the calling thread
+	if (fExpertState != kExpertDeferred && fExpertState != kExpertLoading) return;
+	const Double_t start = Now();
+	if (fExpertState == kExpertLoading) {
+		fExpertLoader->Join();
+		delete fExpertLoader;
+		fExpertLoader = NULL;
+	}
+	else LoadExpert();
+	fExpertState = kExpertReady;
+	// slot 0 belongs to this thread, the loading thread only timed it
+	if (fProfiler) fProfiler->Fill(0, NeuroBayesProfiler::kCreateExpert, fCreateExpertTime);
+	const Double_t waited = Now() - start;
+	if (fInferenceBackend == "Native") SetupNativeNet();
+
+	if (fExpertMode == "Background") 
+		Log() << kINFO << Form("Expert of %s loaded in the background in %.1f ms, the first evaluation waited %.1f ms",
+				       GetMethodName().Data(), 1.e3*fExpertLoadTime, 1.e3*waited) << Endl;
+	else Log() << kINFO << Form("Expert of %s loaded in %.1f ms (%s)", GetMethodName().Data(), 1.e3*fExpertLoadTime,
+				    fExpertMode == "Lazy" ? "at the first evaluation" : "eager") << Endl;
+	if (!fFoldFiles.empty()) Log() << kINFO << "Ensemble of " << fFoldNets.size() + 1 << " fold networks set up" << Endl;
+}
+
+void TMVA::MethodNeuroBayes::ClearExpert()
+{
+	if (fExpertLoader) {
+		fExpertLoader->Join();
+		delete fExpertLoader;
+		fExpertLoader = NULL;
+	}
+	fExpertState = kExpertNone;
+	ClearThreadPool();
+	fNative = NULL;
+	fCheckedNet = NULL;
+	delete fQuantized;
+	fQuantized = NULL;
+	delete Net;
+	Net = NULL;
+	NeuroBayesExpertiseCache::Release(fExpertise);
+	fExpertise = NULL;
+	ClearFolds();
+}
+
+void TMVA::MethodNeuroBayes::LoadFolds()
+{
+	// Net is fold 0 of the ensemble, one more Expert per file of
+	// fFoldFiles. Part of LoadExpert, so it may run on the loading thread.
+	// The Native backend and the scoring threads only serve fold 0.
+	for (UInt_t i=0; i<fFoldFiles.size(); i++) {
+		const NeuroBayesExpertise* expertise = NeuroBayesExpertiseCache::Acquire(fFoldFiles[i].Data());
+		fFoldExpertises.push_back(expertise);
+		fFoldNets.push_back(NeuroBayesExpertiseCache::NewExpert(expertise, fFoldFiles[i].Data()));
+	}
+}
+
+void TMVA::MethodNeuroBayes::ClearFolds()
+{
+	for (UInt_t i=0; i<fFoldNets.size(); i++) {
+		delete fFoldNets[i];
+		NeuroBayesExpertiseCache::Release(fFoldExpertises[i]);
+	}
+	fFoldNets.clear();
+	fFoldExpertises.clear();
+	fFoldFiles.clear();
+}
+
+Long64_t TMVA::MethodNeuroBayes::GetFoldEvent()
+{
+	// index of the current event in the training sample the folds were
+	// trained on in this job, -1 for any other event. The TMVA loops go
+	// through the sample in order, so the event after the last one is
+	// tried first; anything else is looked up by address.
+	if (!fFoldsTrainedHere || Data()->GetCurrentType() != Types::kTraining) return -1;
+	const Event* event = Data()->GetEvent();
+	const std::vector<Event*>& events = Data()->GetEventCollection(Types::kTraining);
+	const Long64_t next = fFoldEventHint + 1;
+	if (next < Long64_t(events.size()) && events[next] == event) return fFoldEventHint = next;
+
+	if (fFoldEventIndex.size() != events.size()) {
+		fFoldEventIndex.resize(events.size());
+		for (UInt_t ievt=0; ievt<events.size(); ievt++) fFoldEventIndex[ievt] = std::make_pair((const Event*)events[ievt], Long64_t(ievt));
+		std::sort(fFoldEventIndex.begin(), fFoldEventIndex.end());
+	}
+	std::vector< std::pair<const Event*, Long64_t> >::const_iterator it = 
+		std::lower_bound(fFoldEventIndex.begin(), fFoldEventIndex.end(), std::make_pair(event, Long64_t(-1)));
+	if (it == fFoldEventIndex.end() || it->first != event) return -1;
+	return fFoldEventHint = it->second;
+}
+
+void TMVA::MethodNeuroBayes::EvaluateFolds( const Double_t* inputs, Long64_t nevents, const Long64_t* events, Double_t* values )
+{
+	// All folds score the same gathered rows. A training event (events
+	// given, index >= 0) gets the response of the fold that did not see
+	// it; any other event the mean of all folds. Folds are the outer loop,
+	// so one network is used for the whole block.
+	if (fExpertState != kExpertReady) WaitForExpert();
+	const Long64_t start = fProfiler ? NeuroBayesProfiler::Now() : 0;
+	const UInt_t nvar = GetNvar();
+	const UInt_t nfolds = fFoldNets.size() + 1;
+	Double_t* rows = const_cast<Double_t*>(inputs);
+	for (Long64_t ievt=0; ievt<nevents; ievt++) values[ievt] = 0;
+	for (UInt_t ifold=0; ifold<nfolds; ifold++) {
+		Expert* net = ifold == 0 ? Net : fFoldNets[ifold-1];
+		for (Long64_t ievt=0; ievt<nevents; ievt++) {
+			const Bool_t own = events && events[ievt] >= 0;
+			if (own && events[ievt] % nfolds != ifold) continue;
+			const Double_t value = net->nb_expert(rows + ievt*nvar);
+			values[ievt] += own ? value : value/nfolds;
+		}
+	}
+	if (fProfiler && nevents > 0) fProfiler->Fill(0, NeuroBayesProfiler::kExpert, (NeuroBayesProfiler::Now() - start)/nevents, nevents);
+}
+
+Expert* TMVA::MethodNeuroBayes::CreateExpert( Long64_t& ns )
+{
+	// may run on the loading thread, so the caller fills the profiler
+	const Long64_t start = NeuroBayesProfiler::Now();
+	Expert* expert = NeuroBayesExpertiseCache::NewExpert(fExpertise, fExpertiseFile.Data());
+	ns = NeuroBayesProfiler::Now() - start;
+	return expert;
+}
+
+void TMVA::MethodNeuroBayes::InitProfiler()
+{
+	// the option is known once the options are parsed, in the Reader only
+	// when the weight file is read
+	if (fProfiler) return;
+	const char* env = gSystem->Getenv("NEUROBAYES_PROFILE");
+	if (!fProfile && !(env && TString(env) != "" && TString(env) != "0")) return;
+	fProfiler = new NeuroBayesProfiler(std::max(fNThreads, 1));
+	Log() << kINFO << "Profiling the evaluation of " << GetMethodName() << Endl;
+}
+
+void TMVA::MethodNeuroBayes::PrintProfile()
+{
+	// summary of the profile so far, to the log and to ProfileFile
+	if (!fProfiler) {
+		Log() << kINFO << "Profile is not enabled for " << GetMethodName() << Endl;
+		return;
+	}
+	const TString title = "Profile of " + GetMethodName() + " (" + fExpertiseFile + ")";
+	Log() << kINFO << title << Endl;
+	const std::vector<std::string> lines = fProfiler->Format();
+	for (UInt_t i=0; i<lines.size(); i++) Log() << kINFO << lines[i] << Endl;
+
+	const TString file = fProfileFile != "" ? fProfileFile : GetJobName() + "_" + GetMethodName() + ".NB_profile.txt";
+	if (fProfiler->Write(file, title)) Log() << kINFO << "Profile written to " << file << Endl;
+	else Log() << kWARNING << "Cannot write the profile to " << file << Endl;
+}
+
+void TMVA::MethodNeuroBayes::SetupNativeNet()
+{
+	// The Expert stays the reference: the native engine only replaces it if
+	// it reads the expertise and reproduces nb_expert within NativeTolerance
+	fNative = fExpertise ? NeuroBayesExpertiseCache::GetNativeNet(fExpertise) : NULL;
+	if (!fNative || fNative->GetNvar() != GetNvar()) {
+		Log() << kWARNING << "Native backend cannot read " << fExpertiseFile << ", using nb_expert"
+		      << " (the experimental engine only knows the stand-in expertise layout)" << Endl;
+		fNative = NULL;
+		return;
+	}
+
+	// flags are only known here if this job configured the Teacher
+	if (preproFlagsarray) {
+		if (fNative->GetPreprocessing() != fPreprocessing)
+			Log() << kWARNING << "Expertise was trained with global preprocessing " << fNative->GetPreprocessing() 
+			      << ", option is " << fPreprocessing << Endl;
+		for (UInt_t ivar=0; ivar<GetNvar(); ivar++) {
+			if (preproFlagsarray[ivar] != "" && preproFlagsarray[ivar].Atoi() != fNative->GetPreproFlag(ivar))
+				Log() << kWARNING << "Expertise has preprocessing flag " << fNative->GetPreproFlag(ivar) 
+				      << " for " << GetInternalVarName(ivar) << ", requested was " << preproFlagsarray[ivar] << Endl;
+		}
+	}
+
+	if (!CheckNativeNet(*fNative)) {
+		Log() << kWARNING << "Native backend does not reproduce nb_expert within " << fNativeTolerance << ", using nb_expert"
+		      << " (the experimental engine only knows the stand-in expertise layout)" << Endl;
+		fNative = NULL;
+		return;
+	}
+	Log() << kINFO << "Using native " << fNative->GetKernelName() << " backend for " << fExpertiseFile << Endl;
+	if (fNativePrecision != "Float") SetupQuantizedNet();
+}
+
+void TMVA::MethodNeuroBayes::SetupQuantizedNet()
+{
+	// Reduced-precision copy of the native network, kept if its deviation
+	// from nb_expert stays within QuantizationTolerance. The deviation is
+	// measured on the TMVA test sample when this job has one (after
+	// Train), otherwise on the inputs of CheckNativeNet.
+	const NeuroBayesQuantizedNet::EPrecision precision = 
+		fNativePrecision == "Half" ? NeuroBayesQuantizedNet::kHalf : NeuroBayesQuantizedNet::kInt8;
+	fQuantized = new NeuroBayesQuantizedNet(*fNative, precision);
+	Log() << kINFO << fNativePrecision << " network (" << fQuantized->GetKernelName() << "): " << fQuantized->GetSize() 
+	      << " bytes of tables and weights, float " << NeuroBayesQuantizedNet::GetSize(*fNative) << " bytes" << Endl;
+
+	const UInt_t nvar = GetNvar();
+	std::vector<Double_t> inputs;
+	TString sample = "test events";
+	const Long64_t ntest = fTask == 1 ? Data()->GetNTestEvents() : 0;
+	if (ntest > 0) {
+		inputs.resize(ntest*nvar);
+		for (Long64_t ievt=0; ievt<ntest; ievt++) {
+			const Event* ev = GetTestingEvent(ievt);
+			for (UInt_t ivar=0; ivar<nvar; ivar++) inputs[ievt*nvar + ivar] = ev->GetValue(ivar);
+		}
+	}
+	else {
+		FillCheckInputs(inputs);
+		sample = "pseudo-random inputs in the training range (no test sample)";
+	}
+	const Long64_t ncheck = inputs.size()/nvar;
+	std::vector<Double_t> quantized(ncheck);
+	fQuantized->Evaluate(&inputs[0], ncheck, &quantized[0]);
+	Double_t maxdev = 0;
+	for (Long64_t i=0; i<ncheck; i++) {
+		maxdev = std::max(maxdev, std::fabs(Net->nb_expert(&inputs[i*nvar]) - quantized[i]));
+	}
+	Log() << kINFO << fNativePrecision << " network: maximum deviation from nb_expert on " << ncheck << " " 
+	      << sample << " is " << maxdev << Endl;
+	if (maxdev > fQuantizationTolerance) {
+		Log() << kWARNING << fNativePrecision << " network exceeds QuantizationTolerance " << fQuantizationTolerance 
+		      << ", using the float native backend" << Endl;
+		delete fQuantized;
+		fQuantized = NULL;
+	}
+}
+
+void TMVA::MethodNeuroBayes::FillCheckInputs( std::vector<Double_t>& inputs )
+{
+	// reproducible pseudo-random input rows, uniform in the training range
+	const UInt_t nvar = GetNvar();
+	const Long64_t ncheck = 1000;
+	inputs.resize(ncheck*nvar);
+	UInt_t seed = 4711;
+	for (Long64_t i=0; i<ncheck; i++) {
+		for (UInt_t ivar=0; ivar<nvar; ivar++) {
+			seed = seed*1103515245u + 12345u;
+			const Double_t u = (seed >> 8)/Double_t(1 << 24);
+			inputs[i*nvar + ivar] = GetXmin(ivar) + u*(GetXmax(ivar) - GetXmin(ivar));
+		}
+	}
+}
+
+Bool_t TMVA::MethodNeuroBayes::CheckNativeNet( const NeuroBayesNativeNet& net )
+{
+	// equivalence check of both backends on reproducible pseudo-random
+	// inputs spread over the training range of every variable
+	const UInt_t nvar = GetNvar();
+	std::vector<Double_t> inputs;
+	FillCheckInputs(inputs);
+	const Long64_t ncheck = inputs.size()/nvar;
+	std::vector<Double_t> native(ncheck);
+	net.Evaluate(&inputs[0], ncheck, &native[0]);
+
+	Double_t maxdev = 0;
+	for (Long64_t i=0; i<ncheck; i++) {
+		maxdev = std::max(maxdev, std::fabs(Net->nb_expert(&inputs[i*nvar]) - native[i]));
+	}
+	Log() << kINFO << "Native backend: maximum deviation from nb_expert on " << ncheck << " inputs is " << maxdev << Endl;
+	return maxdev <= fNativeTolerance;
+}
+
+const TMVA::NeuroBayesNativeNet* TMVA::MethodNeuroBayes::GetExportNet( TString& problem )
+{
+	// The network MakeClass writes: the native one, if it passes the check
+	// of the Native backend. A KFolds ensemble is not exported, fold 0
+	// alone would give other responses than the method.
+	WaitForExpert();
+	problem = "";
+	if (!fFoldFiles.empty()) {
+		problem = "KFolds ensembles cannot be exported";
+		return NULL;
+	}
+	const NeuroBayesNativeNet* net = fExpertise ? NeuroBayesExpertiseCache::GetNativeNet(fExpertise) : NULL;
+	if (!net || net->GetNvar() != GetNvar()) {
+		problem = "the in-plugin engine cannot read it";
+		return NULL;
+	}
+	// fNative passed already; otherwise checked once, MakeClass asks twice
+	if (net == fNative) return net;
+	if (net != fCheckedNet) {
+		fCheckedNet = net;
+		fCheckedNetPassed = CheckNativeNet(*net);
+	}
+	if (!fCheckedNetPassed) {
+		problem = Form("the in-plugin engine does not reproduce nb_expert within %g", fNativeTolerance);
+		return NULL;
+	}
+	return net;
+}
+
+void TMVA::MethodNeuroBayes::SetupThreadPool()
+{
+	// Expert keeps per-call state, so every scoring thread gets its own
+	// instance of the same expertise. The native engine is shared.
+	if (fThreadPool) return;
+	Log() << kINFO << "Setting up " << fNThreads << " scoring threads for " << fExpertiseFile << Endl;
+	fThreadPool = new NeuroBayesThreadPool(fNThreads);
+	for (UInt_t islot=1; islot<fThreadPool->GetNThreads() && !fNative; islot++) {
+		Long64_t ns;
+		fWorkerNets.push_back(CreateExpert(ns));
+		if (fProfiler) fProfiler->Fill(0, NeuroBayesProfiler::kCreateExpert, ns);
+	}
+}
+
+void TMVA::MethodNeuroBayes::ClearThreadPool()
+{
+	delete fThreadPool;
+	fThreadPool = NULL;
+	for (UInt_t i=0; i<fWorkerNets.size(); i++) delete fWorkerNets[i];
+	fWorkerNets.clear();
+}
+
 /* Helper Function to parse individual Preproflags */
 
 void TMVA::MethodNeuroBayes::ParseIndiviPreproFlagFromList(){
@@ -393,9 +2424,7 @@ void TMVA::MethodNeuroBayes::SetIndividualPreproParam(Int_t ivar, TObjArray* Par
 }
 
 /*-------Methods for generating analysis.ps-------------------*/
-void TMVA::MethodNeuroBayes::runAnalysis() {
-		std::cout << "fInputVars size" << fInputVars->size() << std::endl;
-		std::cout << GetInternalVarName(0) << std::endl;
+void TMVA::MethodNeuroBayes::runAnalysis( Bool_t async ) {
 	// check if log file exists. Should also check if it is new enough
 	std::ifstream log("nb_teacher.log");
 	if (log.is_open()) { log.close();}
@@ -410,16 +2439,14 @@ void TMVA::MethodNeuroBayes::runAnalysis() {
 	char** c_varnames;
 	c_varnames = new char*[GetNvar()];
 	for(unsigned int ivar=0; ivar< GetNvar(); ivar++) {
-		/*
-		std::cout << "Nvar = " << GetNvar() << std::endl;
-		std::cout << GetInternalVarName(ivar) << std::endl;
-		*/
 		c_varnames[ivar] = new char[GetInternalVarName(ivar).Length()+8];
 		std::stringstream tmpstring;
 		tmpstring << GetInternalVarName(ivar) << " " << preproFlagsarray[ivar];
 		strcpy(c_varnames[ivar], tmpstring.str().c_str() );
 	}
-	nb->nb_correl_signi(c_varnames,"./"+GetJobName()+"correl_signi.txt","./"+GetJobName()+"correl_signi.html");
+	// per method, a background report of another booking may still read its own
+	const TString correlFile = GetJobName() + "_" + GetMethodName() + "_correl_signi";
+	nb->nb_correl_signi(c_varnames,"./"+correlFile+".txt","./"+correlFile+".html");
 
 	Log() << kINFO << "Executing NeuroBayes analysis macro" << Endl;
 	std::string path = "";
@@ -430,9 +2457,41 @@ void TMVA::MethodNeuroBayes::runAnalysis() {
 	std::stringstream analysis_exec;
 	analysis_exec << "root -b -q $NEUROBAYES/external/analysis.C'(\"ahist.txt\",\"";
 	analysis_exec << PSFileName;
-	analysis_exec << "\",1,\""+GetJobName()+"correl_signi.txt\")'";
+	analysis_exec << "\",1,\""+correlFile+".txt\")'";
 	//gSystem->Exec("root -b -q $NEUROBAYES/external/analysis.C'(\"ahist.txt\",\"analysis.ps\",1,\"correl_signi.txt\")' && echo \"analysis.ps was generated\""); 
-	gSystem->Exec(analysis_exec.str().c_str()); 
+	if (!async) {
+		gSystem->Exec(analysis_exec.str().c_str()); 
+		return;
+	}
+
+	// The macro reads ahist.txt while TMVA goes on, so it gets a copy of
+	// its own; its output goes to a log file instead of the TMVA output
+	const TString prefix = GetJobName() + "_" + GetMethodName();
+	gSystem->CopyFile("ahist.txt", prefix + "_ahist.txt", kTRUE);
+	std::string command = analysis_exec.str();
+	const std::string::size_type pos = command.find("\"ahist.txt\"");
+	if (pos != std::string::npos) command.replace(pos, 11, "\"" + std::string(prefix.Data()) + "_ahist.txt\"");
+	command += " > " + std::string(prefix.Data()) + "_analysis.log 2>&1";
+
+	WaitForAnalysis();
+	fAnalysisCommand = command;
+	fAnalysisJob = AnalysisPool().Submit(new AnalysisJob(command));
+	AnalysisPool().StartPending();
+	Log() << kINFO << "Generating " << PSFileName << " in the background, see " << prefix << "_analysis.log" << Endl;
+}
+
+void TMVA::MethodNeuroBayes::WaitForAnalysis()
+{
+	if (fAnalysisJob < 0) return;
+	Log() << kINFO << "Waiting for the NeuroBayes analysis report of " << GetMethodName() << Endl;
+	Int_t status = AnalysisPool().Wait(fAnalysisJob);
+	if (AnalysisPool().ForkFailed(fAnalysisJob)) {
+		Log() << kWARNING << "Cannot fork for the NeuroBayes analysis report, generating it now" << Endl;
+		status = gSystem->Exec(fAnalysisCommand);
+	}
+	if (status != 0) Log() << kWARNING << "NeuroBayes analysis macro failed with status " << status << Endl;
+	Log() << kINFO << "NeuroBayes analysis report took " << AnalysisPool().GetWallTime(fAnalysisJob) << " s" << Endl;
+	fAnalysisJob = -1;
 }
 
 void TMVA::MethodNeuroBayes::dumpPseudoCodegen(){
@@ -449,6 +2508,169 @@ void TMVA::MethodNeuroBayes::dumpPseudoCodegen(){
 	outfile.close();
 }
 
+void TMVA::MethodNeuroBayes::MakeClassSpecificHeader( std::ostream& fout, const TString& className ) const
+{
+	// The network goes in front of the response class: constexpr tables in
+	// a namespace of its own plus the evaluation loops, templated on the
+	// layer sizes so the compiler can unroll and vectorize them. Values are
+	// evaluated in single precision like the Native backend.
+	// GetExportNet completes a deferred or background load and runs the
+	// equivalence check, neither of which changes the method's responses.
+	TString problem;
+	const NeuroBayesNativeNet* net = const_cast<MethodNeuroBayes*>(this)->GetExportNet(problem);
+	if (!net) return;
+	const UInt_t nvar = net->GetNvar();
+	const UInt_t nhidden = net->GetNhidden();
+	const UInt_t nknots = net->GetNknots();
+
+	fout << "#ifndef NB_CONSTEXPR" << std::endl;
+	fout << "#if __cplusplus >= 201103L" << std::endl;
+	fout << "#define NB_CONSTEXPR constexpr" << std::endl;
+	fout << "#else" << std::endl;
+	fout << "#define NB_CONSTEXPR const" << std::endl;
+	fout << "#endif" << std::endl;
+	fout << "#endif" << std::endl << std::endl;
+
+	fout << "// NeuroBayes network of " << GetMethodName() << ", exported from " << fExpertiseFile << std::endl;
+	fout << "namespace " << className << "_NB {" << std::endl << std::endl;
+	fout << "   NB_CONSTEXPR int kNvar    = " << nvar << ";" << std::endl;
+	fout << "   NB_CONSTEXPR int kNhidden = " << nhidden << ";" << std::endl;
+	if (nknots > 0) fout << "   NB_CONSTEXPR int kNknots  = " << nknots << ";" << std::endl;
+	fout << std::endl;
+
+	// missing value handling and preprocessing tables, one row per variable
+	std::vector<Float_t> row(nvar);
+	fout << "   NB_CONSTEXPR bool kHasMissing[kNvar] = {";
+	for (UInt_t ivar=0; ivar<nvar; ivar++) fout << (ivar ? ", " : " ") << (net->HasMissing(ivar) ? "true" : "false");
+	fout << " };" << std::endl;
+	for (UInt_t ivar=0; ivar<nvar; ivar++) row[ivar] = net->GetMissingValue(ivar);
+	fout << "   NB_CONSTEXPR float kMissingValue[kNvar] = {" << std::endl;
+	WriteFloatArray(fout, &row[0], nvar, "      ");
+	fout << " };" << std::endl;
+	if (nknots > 0) {
+		const char* tables[2] = { "kKnotX", "kKnotY" };
+		for (Int_t itab=0; itab<2; itab++) {
+			fout << "   NB_CONSTEXPR float " << tables[itab] << "[kNvar][kNknots] = {" << std::endl;
+			for (UInt_t ivar=0; ivar<nvar; ivar++) {
+				fout << "    {" << std::endl;
+				WriteFloatArray(fout, itab == 0 ? net->GetKnotX(ivar) : net->GetKnotY(ivar), nknots, "      ");
+				fout << (ivar+1 < nvar ? " }," : " }") << std::endl;
+			}
+			fout << "   };" << std::endl;
+		}
+	}
+	if (net->IsDecorrelated()) {
+		fout << "   NB_CONSTEXPR float kDecorr[kNvar][kNvar] = {" << std::endl;
+		for (UInt_t i=0; i<nvar; i++) {
+			for (UInt_t j=0; j<nvar; j++) row[j] = net->GetDecorrelation(i, j);
+			fout << "    {" << std::endl;
+			WriteFloatArray(fout, &row[0], nvar, "      ");
+			fout << (i+1 < nvar ? " }," : " }") << std::endl;
+		}
+		fout << "   };" << std::endl;
+	}
+
+	// weights, the last input and hidden node is the bias node
+	row.resize(std::max(nvar, nhidden) + 1);
+	fout << "   NB_CONSTEXPR float kW1[kNhidden][kNvar+1] = {" << std::endl;
+	for (UInt_t h=0; h<nhidden; h++) {
+		for (UInt_t ivar=0; ivar<=nvar; ivar++) row[ivar] = net->GetWeight1(h, ivar);
+		fout << "    {" << std::endl;
+		WriteFloatArray(fout, &row[0], nvar+1, "      ");
+		fout << (h+1 < nhidden ? " }," : " }") << std::endl;
+	}
+	fout << "   };" << std::endl;
+	for (UInt_t h=0; h<=nhidden; h++) row[h] = net->GetWeight2(h);
+	fout << "   NB_CONSTEXPR float kW2[kNhidden+1] = {" << std::endl;
+	WriteFloatArray(fout, &row[0], nhidden+1, "      ");
+	fout << " };" << std::endl << std::endl;
+
+	fout << "   inline float Sigmoid( float x ) { return 2.f/(1.f + std::exp(-x)) - 1.f; }" << std::endl << std::endl;
+	fout << "   template <int N>" << std::endl;
+	fout << "   inline float Dot( const float (&w)[N], const float (&x)[N] ) {" << std::endl;
+	fout << "      float sum = 0;" << std::endl;
+	fout << "      for (int i=0; i<N; i++) sum += w[i]*x[i];" << std::endl;
+	fout << "      return sum;" << std::endl;
+	fout << "   }" << std::endl << std::endl;
+	fout << "   // hidden layer, y receives the bias node" << std::endl;
+	fout << "   template <int NIN, int NOUT>" << std::endl;
+	fout << "   inline void Layer( const float (&w)[NOUT][NIN], const float (&x)[NIN], float (&y)[NOUT+1] ) {" << std::endl;
+	fout << "      for (int j=0; j<NOUT; j++) y[j] = Sigmoid(Dot(w[j], x));" << std::endl;
+	fout << "      y[NOUT] = 1;" << std::endl;
+	fout << "   }" << std::endl;
+	if (nknots > 0) {
+		fout << std::endl;
+		fout << "   // preprocessing: linear interpolation between the knots" << std::endl;
+		fout << "   template <int N>" << std::endl;
+		fout << "   inline float Interpolate( const float (&kx)[N], const float (&ky)[N], float v ) {" << std::endl;
+		fout << "      if (v <= kx[0]) return ky[0];" << std::endl;
+		fout << "      if (v >= kx[N-1]) return ky[N-1];" << std::endl;
+		fout << "      int lo = 0, hi = N-1;" << std::endl;
+		fout << "      while (hi - lo > 1) {" << std::endl;
+		fout << "         const int mid = (lo + hi)/2;" << std::endl;
+		fout << "         if (kx[mid] <= v) lo = mid;" << std::endl;
+		fout << "         else hi = mid;" << std::endl;
+		fout << "      }" << std::endl;
+		fout << "      const float dx = kx[hi] - kx[lo];" << std::endl;
+		fout << "      return dx > 0 ? ky[lo] + (ky[hi] - ky[lo])*(v - kx[lo])/dx : ky[lo];" << std::endl;
+		fout << "   }" << std::endl;
+	}
+	fout << "}" << std::endl << std::endl;
+}
+
+void TMVA::MethodNeuroBayes::MakeClassSpecific( std::ostream& fout, const TString& className ) const
+{
+	// closes the response class written by MethodBase::MakeClass and
+	// defines its method-specific members, see MakeClassSpecificHeader
+	TString problem;
+	const NeuroBayesNativeNet* net = const_cast<MethodNeuroBayes*>(this)->GetExportNet(problem);
+	const Bool_t exported = net != NULL;
+	if (!exported)
+		Log() << kERROR << "Cannot export " << fExpertiseFile << " to a standalone class (" << problem << "), "
+		      << className << " is written without a network and flags itself as not usable" << Endl;
+
+	fout << "};" << std::endl << std::endl;
+	if (!exported) {
+		// the class compiles, but reports a bad status instead of responses
+		fout << "inline void " << className << "::Initialize()" << std::endl;
+		fout << "{" << std::endl;
+		fout << "   std::cout << \"ERROR in " << className << ": the NeuroBayes expertise " << fExpertiseFile 
+		     << " could not be exported (" << problem << "), this class cannot be used\" << std::endl;" << std::endl;
+		fout << "   fStatusIsClean = false;" << std::endl;
+		fout << "}" << std::endl << std::endl;
+		fout << "inline void " << className << "::Clear() {}" << std::endl << std::endl;
+		fout << "inline double " << className << "::GetMvaValue__( const std::vector<double>& ) const" << std::endl;
+		fout << "{" << std::endl;
+		fout << "   return 0; // not reached, GetMvaValue checks IsStatusClean" << std::endl;
+		fout << "}" << std::endl;
+		return;
+	}
+	fout << "inline void " << className << "::Initialize() {}" << std::endl << std::endl;
+	fout << "inline void " << className << "::Clear() {}" << std::endl << std::endl;
+	fout << "inline double " << className << "::GetMvaValue__( const std::vector<double>& inputValues ) const" << std::endl;
+	fout << "{" << std::endl;
+	fout << "   using namespace " << className << "_NB;" << std::endl;
+	fout << "   float x[kNvar+1];" << std::endl;
+	fout << "   for (int ivar=0; ivar<kNvar; ivar++) {" << std::endl;
+	fout << "      const float v = inputValues[ivar];" << std::endl;
+	fout << "      if (kHasMissing[ivar] && v == kMissingValue[ivar]) x[ivar] = 0;" << std::endl;
+	if (net->GetNknots() > 0)
+		fout << "      else x[ivar] = Interpolate(kKnotX[ivar], kKnotY[ivar], v);" << std::endl;
+	else
+		fout << "      else x[ivar] = v;" << std::endl;
+	fout << "   }" << std::endl;
+	if (net->IsDecorrelated()) {
+		fout << "   float raw[kNvar];" << std::endl;
+		fout << "   for (int ivar=0; ivar<kNvar; ivar++) raw[ivar] = x[ivar];" << std::endl;
+		fout << "   for (int ivar=0; ivar<kNvar; ivar++) x[ivar] = Dot(kDecorr[ivar], raw);" << std::endl;
+	}
+	fout << "   x[kNvar] = 1; // bias node" << std::endl << std::endl;
+	fout << "   float h[kNhidden+1];" << std::endl;
+	fout << "   Layer(kW1, x, h);" << std::endl;
+	fout << "   return Sigmoid(Dot(kW2, h));" << std::endl;
+	fout << "}" << std::endl;
+}
+
 TMVA::IMethod* TMVA::MethodNeuroBayes::CreateMethodNeuroBayes(const TString& job, const TString& title, TMVA::DataSetInfo& dsi, const TString& option)
 {
 	if(job=="" && title=="") {
@@ -0,0 +1,80 @@
+/****************************************************************
+ * Stratified reservoir sample of the training inputs,
+ * see NeuroBayesDownsampler.h
+ * *************************************************************/
+
+#include <algorithm>
+
+#include "NeuroBayesDownsampler.h"
+
+TMVA::NeuroBayesDownsampler::NeuroBayesDownsampler( UInt_t nvar, Long64_t signalQuota, Long64_t backgroundQuota, ULong64_t seed )
+	: fNvar(nvar), fState(seed)
+{
+	const Long64_t quotas[kNClasses] = { backgroundQuota, signalQuota };
+	for (UInt_t iclass=0; iclass<kNClasses; iclass++) {
+		Reservoir& r = fClasses[iclass];
+		r.quota   = std::max<Long64_t>(quotas[iclass], 0);
+		r.seen    = 0;
+		r.sumSeen = 0;
+		r.scale   = 1;
+		// the quota is an upper bound, do not reserve more than a block up front
+		r.weights.reserve(std::min<Long64_t>(r.quota, 1 << 20));
+		r.inputs.reserve(r.weights.capacity()*nvar);
+	}
+}
+
+Long64_t TMVA::NeuroBayesDownsampler::Random( Long64_t n )
+{
+	// splitmix64
+	ULong64_t z = (fState += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27))*0x94D049BB133111EBULL;
+	z ^= z >> 31;
+	return Long64_t(z % ULong64_t(n));
+}
+
+void TMVA::NeuroBayesDownsampler::Add( const Float_t* inputs, Float_t target, Float_t weight )
+{
+	Reservoir& r = fClasses[target > 0.5 ? kSignal : kBackground];
+	r.seen++;
+	r.sumSeen += weight;
+	if (Long64_t(r.weights.size()) < r.quota) {
+		r.inputs.insert(r.inputs.end(), inputs, inputs + fNvar);
+		r.weights.push_back(weight);
+		return;
+	}
+	// keep the n-th event with probability quota/n, in place of a random kept one
+	if (r.quota == 0) return;
+	const Long64_t j = Random(r.seen);
+	if (j >= r.quota) return;
+	std::copy(inputs, inputs + fNvar, r.inputs.begin() + j*fNvar);
+	r.weights[j] = weight;
+}
+
+void TMVA::NeuroBayesDownsampler::Finish()
+{
+	for (UInt_t iclass=0; iclass<kNClasses; iclass++) {
+		Reservoir& r = fClasses[iclass];
+		Double_t sumKept = 0;
+		for (UInt_t i=0; i<r.weights.size(); i++) sumKept += r.weights[i];
+		r.scale = sumKept > 0 && r.sumSeen > 0 ? r.sumSeen/sumKept : 1;
+	}
+}
+
+void TMVA::NeuroBayesDownsampler::SplitTarget( Long64_t target, Long64_t nsignal, Long64_t nbackground,
+						Long64_t& signalQuota, Long64_t& backgroundQuota )
+{
+	const Long64_t half = target/2;
+	if (nsignal <= half) {
+		signalQuota = nsignal;
+		backgroundQuota = std::min(target - nsignal, nbackground);
+	}
+	else if (nbackground <= target - half) {
+		backgroundQuota = nbackground;
+		signalQuota = std::min(target - nbackground, nsignal);
+	}
+	else {
+		signalQuota = half;
+		backgroundQuota = target - half;
+	}
+}
@@ -0,0 +1,226 @@
+/****************************************************************
+ * Several NeuroBayes networks on shared inputs,
+ * see NeuroBayesExpertGroup.h
+ * *************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <TXMLEngine.h>
+#include "TMVA/MsgLogger.h"
+
+#include "NeuroBayesExpert.hh"
+#include "NeuroBayesExpertGroup.h"
+#include "NeuroBayesExpertiseCache.h"
+#include "NeuroBayesNativeNet.h"
+
+namespace {
+	const Long64_t kBlockSize = 256; // events scored by one network before the next
+
+	// first child of a node with the given name, 0 if there is none
+	XMLNodePointer_t FindChild( TXMLEngine& xml, XMLNodePointer_t node, const char* name ) {
+		for (XMLNodePointer_t child = xml.GetChild(node); child; child = xml.GetNext(child)) {
+			if (TString(xml.GetNodeName(child)) == name) return child;
+		}
+		return 0;
+	}
+}
+
+TMVA::NeuroBayesExpertGroup::NeuroBayesExpertGroup( Bool_t native, Double_t tolerance )
+	: fUseNative(native), fTolerance(tolerance), fLogger(new MsgLogger("NeuroBayesExpertGroup"))
+{
+}
+
+TMVA::NeuroBayesExpertGroup::~NeuroBayesExpertGroup()
+{
+	for (UInt_t i=0; i<fNets.size(); i++) {
+		delete fNets[i].expert;
+		NeuroBayesExpertiseCache::Release(fNets[i].expertise);
+	}
+	delete fLogger;
+}
+
+UInt_t TMVA::NeuroBayesExpertGroup::AddVariable( const TString& variable )
+{
+	const Int_t ivar = GetVariableIndex(variable);
+	if (ivar >= 0) return ivar;
+	fVariables.push_back(variable);
+	fInputs.push_back(0);
+	return fVariables.size() - 1;
+}
+
+Int_t TMVA::NeuroBayesExpertGroup::GetVariableIndex( const TString& variable ) const
+{
+	for (UInt_t ivar=0; ivar<fVariables.size(); ivar++) {
+		if (fVariables[ivar] == variable) return ivar;
+	}
+	return -1;
+}
+
+Int_t TMVA::NeuroBayesExpertGroup::AddExpert( const TString& expertiseFile, const std::vector<TString>& variables, const TString& name )
+{
+	const TString netName = name != "" ? name : expertiseFile;
+	const NeuroBayesExpertise* expertise = NeuroBayesExpertiseCache::Acquire(expertiseFile.Data());
+	if (!expertise) {
+		Log() << kWARNING << "Cannot read the expertise " << expertiseFile << ", " << netName << " not added" << Endl;
+		return -1;
+	}
+	return AddNet(netName, expertiseFile, expertise, variables);
+}
+
+Int_t TMVA::NeuroBayesExpertGroup::AddNet( const TString& name, const TString& expertiseFile, const NeuroBayesExpertise* expertise,
+					   const std::vector<TString>& variables )
+{
+	Net net;
+	net.name = name;
+	net.expertiseFile = expertiseFile;
+	net.expertise = expertise;
+	net.native = 0;
+	net.expert = NeuroBayesExpertiseCache::NewExpert(expertise, expertiseFile.Data());
+
+	// the Expert stays the reference, see MethodNeuroBayes::SetupNativeNet
+	const NeuroBayesNativeNet* native = fUseNative ? NeuroBayesExpertiseCache::GetNativeNet(expertise) : 0;
+	if (native && native->GetNvar() != variables.size()) {
+		Log() << kWARNING << name << ": the expertise has " << native->GetNvar() << " inputs, "
+		      << variables.size() << " variables given; not added" << Endl;
+		delete net.expert;
+		NeuroBayesExpertiseCache::Release(expertise);
+		return -1;
+	}
+	Double_t maxdev = 0;
+	if (native && CheckNative(*native, *net.expert, maxdev)) {
+		net.native = native;
+		delete net.expert;
+		net.expert = 0;
+	}
+	else if (native) {
+		Log() << kWARNING << name << ": native engine deviates by " << maxdev << " from nb_expert (tolerance " 
+		      << fTolerance << "), using nb_expert" << Endl;
+	}
+
+	for (UInt_t i=0; i<variables.size(); i++) net.columns.push_back(AddVariable(variables[i]));
+	fNets.push_back(net);
+	fResponses.resize(fNets.size());
+	Log() << kINFO << "Added " << net.name << " with " << variables.size() << " inputs ("
+	      << (net.native ? "native engine" : "Expert") << "), " << fVariables.size() << " variables in total" << Endl;
+	return fNets.size() - 1;
+}
+
+Bool_t TMVA::NeuroBayesExpertGroup::CheckNative( const NeuroBayesNativeNet& native, Expert& expert, Double_t& maxdev )
+{
+	// Reproducible pseudo-random inputs spread over the range of the
+	// preprocessing tables (the training range, which the group does not
+	// know otherwise) and somewhat beyond; [-2,2] without tables
+	const UInt_t nvar = native.GetNvar();
+	const UInt_t nknots = native.GetNknots();
+	const Long64_t ncheck = 1000;
+	std::vector<Double_t> inputs(ncheck*nvar);
+	UInt_t seed = 4711;
+	for (UInt_t ivar=0; ivar<nvar; ivar++) {
+		Double_t lo = -2, hi = 2;
+		if (nknots > 0) {
+			lo = native.GetKnotX(ivar)[0];
+			hi = native.GetKnotX(ivar)[nknots-1];
+			const Double_t margin = 0.1*(hi - lo);
+			lo -= margin;
+			hi += margin;
+		}
+		for (Long64_t i=0; i<ncheck; i++) {
+			seed = seed*1103515245u + 12345u;
+			inputs[i*nvar + ivar] = lo + (seed >> 8)/Double_t(1 << 24)*(hi - lo);
+		}
+	}
+	std::vector<Double_t> values(ncheck);
+	native.Evaluate(&inputs[0], ncheck, &values[0]);
+	maxdev = 0;
+	for (Long64_t i=0; i<ncheck; i++) {
+		maxdev = std::max(maxdev, std::fabs(expert.nb_expert(&inputs[i*nvar]) - values[i]));
+	}
+	return maxdev <= fTolerance;
+}
+
+Int_t TMVA::NeuroBayesExpertGroup::AddWeightFile( const TString& weightFile, const TString& name )
+{
+	// variable expressions and expertise file of a MethodNeuroBayes weight file
+	TXMLEngine xml;
+	XMLDocPointer_t doc = xml.ParseFile(weightFile.Data());
+	if (!doc) {
+		Log() << kWARNING << "Cannot parse the weight file " << weightFile << Endl;
+		return -1;
+	}
+	XMLNodePointer_t root = xml.DocGetRootElement(doc);
+	XMLNodePointer_t varsNode  = FindChild(xml, root, "Variables");
+	XMLNodePointer_t transNode = FindChild(xml, root, "Transformations");
+	XMLNodePointer_t weights   = FindChild(xml, root, "Weights");
+	XMLNodePointer_t fileNode  = weights ? FindChild(xml, weights, "Expertise") : 0;
+	XMLNodePointer_t dataNode  = weights ? FindChild(xml, weights, "ExpertiseData") : 0;
+
+	TString problem;
+	if (!varsNode || !fileNode || !xml.HasAttr(fileNode, "File")) problem = "it is not the weight file of a NeuroBayes method";
+	else if (transNode && xml.HasAttr(transNode, "NTransformations") && TString(xml.GetAttr(transNode, "NTransformations")).Atoi() > 0)
+		problem = "variable transformations are not supported";
+	else if (FindChild(xml, weights, "FoldExpertise")) problem = "KFolds ensembles are not supported";
+
+	std::vector<TString> variables;
+	TString expertiseFile;
+	const NeuroBayesExpertise* embedded = 0;
+	if (problem == "") {
+		for (XMLNodePointer_t var = xml.GetChild(varsNode); var; var = xml.GetNext(var)) {
+			if (TString(xml.GetNodeName(var)) == "Variable") variables.push_back(xml.GetAttr(var, "Expression"));
+		}
+		expertiseFile = xml.GetAttr(fileNode, "File");
+		// as MethodNeuroBayes::ReadWeightsFromXML, the .nb file is not needed then
+		if (dataNode) {
+			embedded = NeuroBayesExpertiseCache::AcquireEmbedded(xml.GetNodeContent(dataNode), xml.GetAttr(dataNode, "Encoding"),
+									     TString(xml.GetAttr(dataNode, "Size")).Atoi());
+			if (!embedded) Log() << kWARNING << "Embedded expertise of " << weightFile << " is corrupt, falling back to " << expertiseFile << Endl;
+		}
+	}
+	xml.FreeDoc(doc);
+	if (problem != "") {
+		Log() << kWARNING << "Cannot use " << weightFile << ": " << problem << Endl;
+		return -1;
+	}
+	if (embedded) return AddNet(name != "" ? name : weightFile, expertiseFile, embedded, variables);
+	return AddExpert(expertiseFile, variables, name != "" ? name : weightFile);
+}
+
+const std::vector<Double_t>& TMVA::NeuroBayesExpertGroup::Evaluate()
+{
+	if (!fNets.empty()) EvaluateBatch(GetInputs(), 1, &fResponses[0]);
+	return fResponses;
+}
+
+void TMVA::NeuroBayesExpertGroup::EvaluateBatch( const Double_t* inputs, Long64_t nevents, Double_t* responses )
+{
+	// per block: gather the columns of one network, score the block,
+	// then the next network
+	const UInt_t nvariables = fVariables.size();
+	const UInt_t nexperts = fNets.size();
+	for (Long64_t first=0; first<nevents; first+=kBlockSize) {
+		const Long64_t n = std::min(kBlockSize, nevents - first);
+		const Double_t* block = inputs + first*nvariables;
+		for (UInt_t iexpert=0; iexpert<nexperts; iexpert++) {
+			const Net& net = fNets[iexpert];
+			const UInt_t nvar = net.columns.size();
+			fValues.resize(n);
+			if (net.native) {
+				fGathered.resize(n*nvar);
+				for (Long64_t ievt=0; ievt<n; ievt++) {
+					const Double_t* event = block + ievt*nvariables;
+					Double_t* row = &fGathered[ievt*nvar];
+					for (UInt_t ivar=0; ivar<nvar; ivar++) row[ivar] = event[net.columns[ivar]];
+				}
+				net.native->Evaluate(&fGathered[0], n, &fValues[0]);
+			}
+			else {
+				fRow.resize(nvar);
+				for (Long64_t ievt=0; ievt<n; ievt++) {
+					const Double_t* event = block + ievt*nvariables;
+					for (UInt_t ivar=0; ivar<nvar; ivar++) fRow[ivar] = event[net.columns[ivar]];
+					fValues[ievt] = net.expert->nb_expert(&fRow[0]);
+				}
+			}
+			for (Long64_t ievt=0; ievt<n; ievt++) responses[(first + ievt)*nexperts + iexpert] = fValues[ievt];
+		}
+	}
+}
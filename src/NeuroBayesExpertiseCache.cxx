@@ -0,0 +1,162 @@
+/****************************************************************
+ * Process-wide cache of parsed expertises, see
+ * NeuroBayesExpertiseCache.h
+ * *************************************************************/
+
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <TBase64.h>
+#include <RZip.h>
+
+#include "NeuroBayesExpert.hh"
+#include "NeuroBayesExpertiseCache.h"
+#include "NeuroBayesNativeNet.h"
+#include "NeuroBayesSample.h"
+
+namespace {
+	pthread_mutex_t gCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+	pthread_mutex_t gExpertMutex = PTHREAD_MUTEX_INITIALIZER;
+
+	class CacheLock {
+	public:
+		CacheLock( pthread_mutex_t& mutex = gCacheMutex ) : fMutex(mutex) { pthread_mutex_lock(&fMutex); }
+		~CacheLock() { pthread_mutex_unlock(&fMutex); }
+	private:
+		pthread_mutex_t& fMutex;
+	};
+
+	// raw expertise file contents of an ExpertiseData node
+	Bool_t DecodeExpertise( const char* content, const TString& encoding, Int_t size, std::string& raw ) {
+		std::string text;
+		for (const char* c = content; *c; c++) if (!isspace(*c)) text += *c;
+		TString decoded = TBase64::Decode(text.c_str());
+		if (encoding == "base64") {
+			raw.assign(decoded.Data(), decoded.Length());
+			return Int_t(raw.size()) == size;
+		}
+		if (encoding != "zip+base64" || size <= 0) return kFALSE;
+		raw.resize(size);
+		int srcsize = decoded.Length(), tgtsize = size, irep = 0;
+		R__unzip(&srcsize, (unsigned char*)decoded.Data(), &tgtsize, (unsigned char*)&raw[0], &irep);
+		return irep == size;
+	}
+}
+
+TMVA::NeuroBayesExpertise::~NeuroBayesExpertise()
+{
+	delete fNative;
+}
+
+TMVA::NeuroBayesExpertiseCache::EntryMap& TMVA::NeuroBayesExpertiseCache::Entries()
+{
+	// never destroyed: Readers may still release expertises during exit
+	static EntryMap* entries = new EntryMap;
+	return *entries;
+}
+
+TString TMVA::NeuroBayesExpertiseCache::FileKey( const char* filename )
+{
+	char path[PATH_MAX];
+	struct stat st;
+	if (!realpath(filename, path) || stat(path, &st) != 0) return "";
+	return TString::Format("file:%s:%lld.%09ld", path, (Long64_t)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec);
+}
+
+const TMVA::NeuroBayesExpertise* TMVA::NeuroBayesExpertiseCache::Acquire( const char* filename )
+{
+	const TString key = FileKey(filename);
+	if (key == "") return 0;
+	const NeuroBayesExpertise* entry = Find(key);
+	if (entry) return entry;
+
+	// parse outside the lock, concurrent first loads of different files
+	// should not wait for each other
+	std::vector<Float_t> data;
+	if (!NeuroBayesNativeNet::ReadExpertiseFile(filename, data)) return 0;
+	return Insert(key, data);
+}
+
+const TMVA::NeuroBayesExpertise* TMVA::NeuroBayesExpertiseCache::AcquireEmbedded( const char* content, const TString& encoding, Int_t size )
+{
+	// readers of the same weight file share the decoded contents
+	if (!content) return 0;
+	const TString key = TString::Format("embedded:%llx", NeuroBayesSample::Hash(content, strlen(content)));
+	const NeuroBayesExpertise* entry = Find(key);
+	if (entry) return entry;
+
+	std::string raw;
+	std::vector<Float_t> data;
+	if (!DecodeExpertise(content, encoding, size, raw)) return 0;
+	std::istringstream in(raw);
+	if (!NeuroBayesNativeNet::ReadExpertiseStream(in, data)) return 0;
+	return Insert(key, data);
+}
+
+const TMVA::NeuroBayesExpertise* TMVA::NeuroBayesExpertiseCache::Find( const TString& key )
+{
+	CacheLock lock;
+	EntryMap::iterator it = Entries().find(key);
+	if (it == Entries().end()) return 0;
+	it->second->fRefs++;
+	return it->second;
+}
+
+const TMVA::NeuroBayesExpertise* TMVA::NeuroBayesExpertiseCache::Insert( const TString& key, std::vector<Float_t>& data )
+{
+	CacheLock lock;
+	EntryMap::iterator it = Entries().find(key);
+	if (it != Entries().end()) {
+		it->second->fRefs++;
+		return it->second;
+	}
+	NeuroBayesExpertise* entry = new NeuroBayesExpertise(key);
+	entry->fData.swap(data);
+	Entries()[key] = entry;
+	return entry;
+}
+
+void TMVA::NeuroBayesExpertiseCache::Release( const NeuroBayesExpertise* entry )
+{
+	if (!entry) return;
+	CacheLock lock;
+	NeuroBayesExpertise* e = const_cast<NeuroBayesExpertise*>(entry);
+	if (--e->fRefs > 0) return;
+	Entries().erase(e->fKey);
+	delete e;
+}
+
+const TMVA::NeuroBayesNativeNet* TMVA::NeuroBayesExpertiseCache::GetNativeNet( const NeuroBayesExpertise* entry )
+{
+	CacheLock lock;
+	NeuroBayesExpertise* e = const_cast<NeuroBayesExpertise*>(entry);
+	if (!e->fNativeRead) {
+		e->fNativeRead = kTRUE;
+		e->fNative = new NeuroBayesNativeNet();
+		if (!e->fNative->SetExpertise(e->fData)) {
+			delete e->fNative;
+			e->fNative = 0;
+		}
+	}
+	return e->fNative;
+}
+
+Expert* TMVA::NeuroBayesExpertiseCache::NewExpert( const NeuroBayesExpertise* entry, const char* filename )
+{
+	// a lock of its own, a slow construction does not block the cache.
+	// Expert(float*) does not modify the expertise array.
+	CacheLock lock(gExpertMutex);
+	return entry ? new Expert(const_cast<Float_t*>(&entry->GetData()[0])) : new Expert(filename);
+}
+
+UInt_t TMVA::NeuroBayesExpertiseCache::GetNEntries()
+{
+	CacheLock lock;
+	return Entries().size();
+}
@@ -0,0 +1,175 @@
+/****************************************************************
+ * Streaming statistics of the NeuroBayes training inputs,
+ * see NeuroBayesInputStatistics.h
+ * *************************************************************/
+
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+
+#include "NeuroBayesInputStatistics.h"
+
+namespace {
+	// in-place inverse of a symmetric positive definite matrix through its
+	// Cholesky decomposition, kFALSE if the matrix is not positive definite
+	Bool_t InvertSymmetric( std::vector<Double_t>& a, UInt_t n ) {
+		std::vector<Double_t> l(size_t(n)*n, 0);
+		for (UInt_t j=0; j<n; j++) {
+			Double_t d = a[j*n + j];
+			for (UInt_t k=0; k<j; k++) d -= l[j*n + k]*l[j*n + k];
+			if (d <= 0) return kFALSE;
+			l[j*n + j] = std::sqrt(d);
+			for (UInt_t i=j+1; i<n; i++) {
+				Double_t s = a[i*n + j];
+				for (UInt_t k=0; k<j; k++) s -= l[i*n + k]*l[j*n + k];
+				l[i*n + j] = s/l[j*n + j];
+			}
+		}
+		// columns of L^-1, then A^-1 = L^-T L^-1
+		std::vector<Double_t> linv(size_t(n)*n, 0);
+		for (UInt_t j=0; j<n; j++) {
+			linv[j*n + j] = 1/l[j*n + j];
+			for (UInt_t i=j+1; i<n; i++) {
+				Double_t s = 0;
+				for (UInt_t k=j; k<i; k++) s -= l[i*n + k]*linv[k*n + j];
+				linv[i*n + j] = s/l[i*n + i];
+			}
+		}
+		for (UInt_t i=0; i<n; i++) {
+			for (UInt_t j=0; j<=i; j++) {
+				Double_t s = 0;
+				for (UInt_t k=i; k<n; k++) s += linv[k*n + i]*linv[k*n + j];
+				a[i*n + j] = a[j*n + i] = s;
+			}
+		}
+		return kTRUE;
+	}
+}
+
+TMVA::NeuroBayesInputStatistics::NeuroBayesInputStatistics( UInt_t nvar )
+{
+	Reset(nvar);
+}
+
+void TMVA::NeuroBayesInputStatistics::Reset( UInt_t nvar )
+{
+	fNvar    = nvar;
+	fDim     = nvar + 1;
+	fNevents = 0;
+	fSumW    = 0;
+	fSumW2   = 0;
+	fMean.assign(fDim, 0);
+	fComoment.assign(size_t(fDim)*fDim, 0);
+	fDeltaOld.assign(fDim, 0);
+	fDeltaNew.assign(fDim, 0);
+}
+
+void TMVA::NeuroBayesInputStatistics::Fill( const Float_t* inputs, Float_t target, Float_t weight )
+{
+	// C += w (x - mean_old)(x - mean_new)^T, one row of the upper triangle
+	// at a time; the inner loops run over contiguous arrays
+	if (!(weight > 0)) return;
+	fNevents++;
+	fSumW  += weight;
+	fSumW2 += Double_t(weight)*weight;
+	const Double_t f = weight/fSumW;
+
+	Double_t* dold = &fDeltaOld[0];
+	Double_t* dnew = &fDeltaNew[0];
+	Double_t* mean = &fMean[0];
+	for (UInt_t k=0; k<fNvar; k++) dold[k] = inputs[k] - mean[k];
+	dold[fNvar] = target - mean[fNvar];
+	for (UInt_t k=0; k<fDim; k++) mean[k] += f*dold[k];
+	for (UInt_t k=0; k<fNvar; k++) dnew[k] = inputs[k] - mean[k];
+	dnew[fNvar] = target - mean[fNvar];
+
+	for (UInt_t i=0; i<fDim; i++) {
+		const Double_t a = weight*dold[i];
+		Double_t* c = &fComoment[i*fDim];
+		for (UInt_t j=i; j<fDim; j++) c[j] += a*dnew[j];
+	}
+}
+
+Double_t TMVA::NeuroBayesInputStatistics::GetCorrelation( UInt_t ivar, UInt_t jvar ) const
+{
+	const Double_t norm = GetComoment(ivar, ivar)*GetComoment(jvar, jvar);
+	return norm > 0 ? GetComoment(ivar, jvar)/std::sqrt(norm) : 0;
+}
+
+Bool_t TMVA::NeuroBayesInputStatistics::GetCorrelationLoss( Double_t& total, std::vector<Double_t>& loss ) const
+{
+	// With R the input correlation matrix and r the correlations to the
+	// target, the total correlation is R^2 = r^T R^-1 r. Removing variable
+	// k lowers it by b_k^2/(R^-1)_kk with b = R^-1 r, and the inverse of
+	// the remaining matrix follows from R^-1 by a rank-one downdate.
+	// Variables are removed least important first, as in the NeuroBayes
+	// analysis, so of two collinear inputs only the first one removed gets
+	// a small loss. Constant variables are decoupled and get no loss.
+	const UInt_t n = fNvar;
+	loss.assign(n, 0);
+	total = 0;
+	if (n == 0 || fNevents < 2) return kFALSE;
+
+	std::vector<Double_t> rinv(size_t(n)*n, 0), r(n), b(n);
+	for (UInt_t i=0; i<n; i++) {
+		r[i] = GetTargetCorrelation(i);
+		for (UInt_t j=0; j<n; j++) rinv[i*n + j] = (i == j ? 1 : GetCorrelation(i, j));
+	}
+	// a tiny ridge keeps exactly collinear inputs invertible
+	for (UInt_t i=0; i<n; i++) rinv[i*n + i] += 1.e-9;
+	if (!InvertSymmetric(rinv, n)) return kFALSE;
+
+	std::vector<Char_t> active(n, 1);
+	for (UInt_t step=0; step<n; step++) {
+		Int_t kmin = -1;
+		for (UInt_t i=0; i<n; i++) {
+			if (!active[i]) continue;
+			b[i] = 0;
+			for (UInt_t j=0; j<n; j++) if (active[j]) b[i] += rinv[i*n + j]*r[j];
+			if (step == 0) total += b[i]*r[i];
+			const Double_t li = rinv[i*n + i] > 0 ? b[i]*b[i]/rinv[i*n + i] : 0;
+			if (kmin < 0 || li < loss[kmin]) kmin = i;
+			loss[i] = li;
+		}
+		const UInt_t k = kmin;
+		active[k] = 0;
+		const Double_t pivot = rinv[k*n + k];
+		if (pivot <= 0) continue;
+		for (UInt_t i=0; i<n; i++) {
+			if (!active[i]) continue;
+			const Double_t f = rinv[i*n + k]/pivot;
+			for (UInt_t j=0; j<n; j++) if (active[j]) rinv[i*n + j] -= f*rinv[k*n + j];
+		}
+	}
+	return kTRUE;
+}
+
+Bool_t TMVA::NeuroBayesInputStatistics::Write( const char* filename ) const
+{
+	std::ofstream out(filename);
+	out << std::setprecision(17);
+	out << fNvar << " " << fNevents << " " << fSumW << " " << fSumW2 << std::endl;
+	for (UInt_t i=0; i<fDim; i++) out << fMean[i] << (i+1 < fDim ? " " : "\n");
+	for (UInt_t i=0; i<fDim; i++) {
+		for (UInt_t j=i; j<fDim; j++) out << fComoment[i*fDim + j] << (j+1 < fDim ? " " : "\n");
+	}
+	return out.good();
+}
+
+Bool_t TMVA::NeuroBayesInputStatistics::Read( const char* filename )
+{
+	std::ifstream in(filename);
+	UInt_t nvar;
+	if (!(in >> nvar)) return kFALSE;
+	Reset(nvar);
+	in >> fNevents >> fSumW >> fSumW2;
+	for (UInt_t i=0; i<fDim; i++) in >> fMean[i];
+	for (UInt_t i=0; i<fDim; i++) {
+		for (UInt_t j=i; j<fDim; j++) in >> fComoment[i*fDim + j];
+	}
+	if (in.fail()) {
+		Reset(nvar);
+		return kFALSE;
+	}
+	return kTRUE;
+}
@@ -0,0 +1,284 @@
+/****************************************************************
+ * In-plugin inference engine for NeuroBayes expertises,
+ * see NeuroBayesNativeNet.h
+ *
+ * The expertise is a flat array of floats. NeuroBayes does not
+ * document its layout; the engine assumes the one below, which is
+ * what the stand-in Teacher of bench/standin writes. Expertises of
+ * the real Teacher are only used natively if they pass the check of
+ * MethodNeuroBayes against nb_expert at load time (NativeTolerance),
+ * anything else stays on the Expert:
+ *
+ *   header        NODE1 NODE2 NODE3 PRE NKNOTS DECORR
+ *   per variable  FLAG MISSING MISSINGVALUE X[NKNOTS] Y[NKNOTS]
+ *                 (NODE1-1 variables, NODE1 includes the bias node)
+ *   if DECORR     decorrelation matrix [NODE1-1][NODE1-1]
+ *   weights       input->hidden  [NODE2-1][NODE1]
+ *                 hidden->output [NODE3][NODE2]
+ *
+ * The tables map a raw input to its preprocessed value by linear
+ * interpolation between the knots, i.e. they hold whatever the Teacher
+ * derived from the global and the individual preprocessing flags.
+ * Hidden and output nodes use the symmetric sigmoid 2/(1+exp(-x))-1,
+ * so the output is in [-1,1] like Expert::nb_expert.
+ * *************************************************************/
+
+#include <cmath>
+#include <fstream>
+#include <algorithm>
+
+#include "NeuroBayesNativeNet.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NB_NATIVE_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+	enum { kNodes1, kNodes2, kNodes3, kPre, kNknots, kDecorr, kHeaderSize };
+
+	const UInt_t kPad  = 16; // floats, one AVX-512 register
+	const UInt_t kTile = 32; // events preprocessed and scored together
+	// scratch floats of Evaluate kept on the stack, up to a combined
+	// input and hidden stride of about 250
+	const UInt_t kStackFloats = 8192;
+
+	UInt_t PadTo( UInt_t n ) { return (n + kPad - 1)/kPad*kPad; }
+
+	const Float_t kOnes[kPad] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 };
+
+	// all kernels require n to be a multiple of kPad
+
+	void AxpyScalar( Float_t a, const Float_t* w, Float_t* acc, UInt_t n ) {
+		for (UInt_t i=0; i<n; i++) acc[i] += a*w[i];
+	}
+
+	Float_t DotScalar( const Float_t* a, const Float_t* b, UInt_t n ) {
+		Float_t sum = 0;
+		for (UInt_t i=0; i<n; i++) sum += a[i]*b[i];
+		return sum;
+	}
+
+#ifdef NB_NATIVE_X86
+	__attribute__((target("avx2,fma")))
+	void AxpyAvx2( Float_t a, const Float_t* w, Float_t* acc, UInt_t n ) {
+		const __m256 va = _mm256_set1_ps(a);
+		for (UInt_t i=0; i<n; i+=8) {
+			_mm256_storeu_ps(acc+i, _mm256_fmadd_ps(va, _mm256_loadu_ps(w+i), _mm256_loadu_ps(acc+i)));
+		}
+	}
+
+	__attribute__((target("avx2,fma")))
+	Float_t DotAvx2( const Float_t* a, const Float_t* b, UInt_t n ) {
+		__m256 sum = _mm256_setzero_ps();
+		for (UInt_t i=0; i<n; i+=8) {
+			sum = _mm256_fmadd_ps(_mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i), sum);
+		}
+		__m128 s = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+		s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+		s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+		return _mm_cvtss_f32(s);
+	}
+
+	__attribute__((target("avx512f")))
+	void AxpyAvx512( Float_t a, const Float_t* w, Float_t* acc, UInt_t n ) {
+		const __m512 va = _mm512_set1_ps(a);
+		for (UInt_t i=0; i<n; i+=16) {
+			_mm512_storeu_ps(acc+i, _mm512_fmadd_ps(va, _mm512_loadu_ps(w+i), _mm512_loadu_ps(acc+i)));
+		}
+	}
+
+	__attribute__((target("avx512f")))
+	Float_t DotAvx512( const Float_t* a, const Float_t* b, UInt_t n ) {
+		__m512 sum = _mm512_setzero_ps();
+		for (UInt_t i=0; i<n; i+=16) {
+			sum = _mm512_fmadd_ps(_mm512_loadu_ps(a+i), _mm512_loadu_ps(b+i), sum);
+		}
+		Float_t lanes[16];
+		_mm512_storeu_ps(lanes, sum);
+		return DotScalar(lanes, kOnes, 16);
+	}
+#endif
+}
+
+TMVA::NeuroBayesNativeNet::NeuroBayesNativeNet()
+	: fNvar(0), fNhidden(0), fNknots(0), fInputStride(0), fHiddenStride(0),
+	  fPreprocessing(0), fDecorrelate(kFALSE)
+{
+	SelectKernels();
+}
+
+void TMVA::NeuroBayesNativeNet::SelectKernels()
+{
+	fAxpy = &AxpyScalar;
+	fDot  = &DotScalar;
+	fKernelName = "scalar";
+#ifdef NB_NATIVE_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		fAxpy = &AxpyAvx512;
+		fDot  = &DotAvx512;
+		fKernelName = "AVX-512";
+	}
+	else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		fAxpy = &AxpyAvx2;
+		fDot  = &DotAvx2;
+		fKernelName = "AVX2";
+	}
+#endif
+}
+
+const char* TMVA::NeuroBayesNativeNet::GetKernelName() const
+{
+	return fKernelName;
+}
+
+Bool_t TMVA::NeuroBayesNativeNet::ReadExpertiseFile( const char* filename, std::vector<Float_t>& expertise )
+{
+	std::ifstream in(filename);
+	if (!in.is_open()) return kFALSE;
+	return ReadExpertiseStream(in, expertise);
+}
+
+Bool_t TMVA::NeuroBayesNativeNet::ReadExpertiseStream( std::istream& in, std::vector<Float_t>& expertise )
+{
+	expertise.clear();
+	Float_t value;
+	while (in >> value) expertise.push_back(value);
+	return in.eof() && !expertise.empty();
+}
+
+Bool_t TMVA::NeuroBayesNativeNet::ReadExpertise( const char* filename )
+{
+	std::vector<Float_t> expertise;
+	if (!ReadExpertiseFile(filename, expertise)) return kFALSE;
+	return SetExpertise(expertise);
+}
+
+Bool_t TMVA::NeuroBayesNativeNet::SetExpertise( const std::vector<Float_t>& expertise )
+{
+	if (expertise.size() < kHeaderSize) return kFALSE;
+	const Int_t nodes1 = Int_t(expertise[kNodes1]);
+	const Int_t nodes2 = Int_t(expertise[kNodes2]);
+	const Int_t nodes3 = Int_t(expertise[kNodes3]);
+	const Int_t nknots = Int_t(expertise[kNknots]);
+	// only binominal classification nets (NB_DEF_NODE3(1)) are supported
+	if (nodes1 < 2 || nodes2 < 2 || nodes3 != 1 || nknots < 0) return kFALSE;
+
+	const UInt_t nvar = nodes1 - 1;
+	const Bool_t decorrelate = expertise[kDecorr] != 0;
+	const size_t expected = kHeaderSize + size_t(nvar)*(3 + 2*nknots)
+		+ (decorrelate ? size_t(nvar)*nvar : 0)
+		+ size_t(nodes2 - 1)*nodes1 + size_t(nodes3)*nodes2;
+	if (expertise.size() != expected) return kFALSE;
+
+	fNvar          = nvar;
+	fNhidden       = nodes2 - 1;
+	fNknots        = nknots;
+	fInputStride   = PadTo(nodes1);
+	fHiddenStride  = PadTo(nodes2);
+	fPreprocessing = Int_t(expertise[kPre]);
+	fDecorrelate   = decorrelate;
+
+	const Float_t* p = &expertise[kHeaderSize];
+	fPreproFlags.assign(nvar, 0);
+	fHasMissing.assign(nvar, kFALSE);
+	fMissingValue.assign(nvar, 0);
+	fKnotX.assign(size_t(nvar)*nknots, 0);
+	fKnotY.assign(size_t(nvar)*nknots, 0);
+	for (UInt_t ivar=0; ivar<nvar; ivar++) {
+		fPreproFlags[ivar]  = Int_t(*p++);
+		fHasMissing[ivar]   = (*p++ != 0);
+		fMissingValue[ivar] = *p++;
+		std::copy(p, p + nknots, fKnotX.begin() + ivar*nknots); p += nknots;
+		std::copy(p, p + nknots, fKnotY.begin() + ivar*nknots); p += nknots;
+	}
+
+	fDecorr.assign(decorrelate ? size_t(nvar)*fInputStride : 0, 0);
+	if (decorrelate) {
+		for (UInt_t i=0; i<nvar; i++) {
+			for (UInt_t j=0; j<nvar; j++) fDecorr[i*fInputStride + j] = *p++;
+		}
+	}
+
+	// store the first layer transposed, one padded row per input node, so
+	// a hidden layer is accumulated with one axpy per input
+	fW1T.assign(size_t(nodes1)*fHiddenStride, 0);
+	for (UInt_t h=0; h<fNhidden; h++) {
+		for (Int_t i=0; i<nodes1; i++) fW1T[i*fHiddenStride + h] = *p++;
+	}
+	fW2.assign(fHiddenStride, 0);
+	for (Int_t h=0; h<nodes2; h++) fW2[h] = *p++;
+
+	return kTRUE;
+}
+
+void TMVA::NeuroBayesNativeNet::Preprocess( const Double_t* input, Float_t* x, Float_t* scratch ) const
+{
+	// x and scratch have fInputStride entries; x receives the nvar
+	// preprocessed inputs, the bias node and zero padding
+	for (UInt_t ivar=0; ivar<fNvar; ivar++) {
+		const Float_t v = input[ivar];
+		if (fHasMissing[ivar] && v == fMissingValue[ivar]) { x[ivar] = 0; continue; }
+		if (fNknots == 0) { x[ivar] = v; continue; }
+
+		const Float_t* kx = &fKnotX[ivar*fNknots];
+		const Float_t* ky = &fKnotY[ivar*fNknots];
+		if (v <= kx[0]) x[ivar] = ky[0];
+		else if (v >= kx[fNknots-1]) x[ivar] = ky[fNknots-1];
+		else {
+			const UInt_t k = std::upper_bound(kx, kx + fNknots, v) - kx - 1;
+			const Float_t dx = kx[k+1] - kx[k];
+			x[ivar] = dx > 0 ? ky[k] + (ky[k+1] - ky[k])*(v - kx[k])/dx : ky[k];
+		}
+	}
+	std::fill(x + fNvar, x + fInputStride, 0.f);
+
+	if (fDecorrelate) {
+		std::copy(x, x + fInputStride, scratch);
+		for (UInt_t i=0; i<fNvar; i++) x[i] = fDot(&fDecorr[i*fInputStride], scratch, fInputStride);
+	}
+	x[fNvar] = 1; // bias node
+}
+
+Float_t TMVA::NeuroBayesNativeNet::Sigmoid( Float_t x )
+{
+	return 2.f/(1.f + std::exp(-x)) - 1.f;
+}
+
+void TMVA::NeuroBayesNativeNet::Evaluate( const Double_t* inputs, Long64_t nevents, Double_t* values ) const
+{
+	// a call does not touch the allocator unless the network is unusually
+	// large; the scratch space is still local, so the call is reentrant
+	Float_t local[kStackFloats];
+	std::vector<Float_t> heap;
+	Float_t* x = local;
+	const size_t nscratch = size_t(kTile)*(fInputStride + fHiddenStride) + fInputStride;
+	if (nscratch > kStackFloats) {
+		heap.resize(nscratch);
+		x = &heap[0];
+	}
+	Float_t* acc = x + kTile*fInputStride;
+	Float_t* scratch = acc + kTile*fHiddenStride;
+	const UInt_t ninputs = fNvar + 1;
+
+	for (Long64_t first=0; first<nevents; first+=kTile) {
+		const UInt_t ntile = UInt_t(std::min<Long64_t>(kTile, nevents - first));
+		for (UInt_t e=0; e<ntile; e++) Preprocess(inputs + (first + e)*fNvar, x + e*fInputStride, scratch);
+
+		// hidden layer: every weight row stays in L1 while the whole
+		// tile of events is accumulated
+		std::fill(acc, acc + kTile*fHiddenStride, 0.f);
+		for (UInt_t i=0; i<ninputs; i++) {
+			const Float_t* w = &fW1T[i*fHiddenStride];
+			for (UInt_t e=0; e<ntile; e++) fAxpy(x[e*fInputStride + i], w, acc + e*fHiddenStride, fHiddenStride);
+		}
+
+		for (UInt_t e=0; e<ntile; e++) {
+			Float_t* h = acc + e*fHiddenStride;
+			for (UInt_t j=0; j<fNhidden; j++) h[j] = Sigmoid(h[j]);
+			h[fNhidden] = 1; // bias node, the padding stays 0
+			values[first + e] = Sigmoid(fDot(&fW2[0], h, fHiddenStride));
+		}
+	}
+}
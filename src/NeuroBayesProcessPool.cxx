@@ -0,0 +1,152 @@
+/****************************************************************
+ * Forked worker processes for concurrent NeuroBayes trainings,
+ * see NeuroBayesProcessPool.h
+ * *************************************************************/
+
+#include <cstdio>
+#include <iostream>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "NeuroBayesProcessPool.h"
+
+TMVA::NeuroBayesProcessPool::NeuroBayesProcessPool( UInt_t maxWorkers )
+	: fRunning(0)
+{
+	SetMaxWorkers(maxWorkers);
+}
+
+TMVA::NeuroBayesProcessPool::~NeuroBayesProcessPool()
+{
+	// never leave orphaned workers behind; jobs not started are dropped
+	for (UInt_t id=0; id<fEntries.size(); id++) {
+		if (fEntries[id].state == kPending) Cancel(id);
+	}
+	WaitAll();
+	for (UInt_t id=0; id<fEntries.size(); id++) delete fEntries[id].job;
+}
+
+void TMVA::NeuroBayesProcessPool::SetMaxWorkers( UInt_t maxWorkers )
+{
+	if (maxWorkers == 0) {
+		long ncores = sysconf(_SC_NPROCESSORS_ONLN);
+		maxWorkers = ncores > 0 ? ncores : 1;
+	}
+	fMaxWorkers = maxWorkers;
+}
+
+Int_t TMVA::NeuroBayesProcessPool::Submit( Job* job )
+{
+	Entry entry;
+	entry.job    = job;
+	entry.pid    = -1;
+	entry.state  = kPending;
+	entry.status = -1;
+	entry.start  = 0;
+	entry.stop   = 0;
+	fEntries.push_back(entry);
+	return fEntries.size() - 1;
+}
+
+void TMVA::NeuroBayesProcessPool::Cancel( Int_t id )
+{
+	if (fEntries[id].state != kPending) return;
+	fEntries[id].state = kCancelled;
+	delete fEntries[id].job;
+	fEntries[id].job = 0;
+}
+
+void TMVA::NeuroBayesProcessPool::Start( Entry& entry )
+{
+	// buffered output would otherwise be written twice
+	std::cout.flush();
+	std::cerr.flush();
+	fflush(0);
+
+	entry.start = Now();
+	pid_t pid = fork();
+	if (pid == 0) {
+		Int_t status = entry.job->Run();
+		std::cout.flush();
+		std::cerr.flush();
+		fflush(0);
+		// skip the exit handlers and destructors of the parent's objects
+		_exit(status);
+	}
+	if (pid < 0) {
+		// could not fork. Jobs set up their worker process (working
+		// directory, output, Teacher) and must not run in this one, the
+		// caller decides how to go on.
+		perror("NeuroBayesProcessPool: fork");
+		entry.status = -1;
+		entry.stop   = Now();
+		entry.state  = kForkFailed;
+		return;
+	}
+	entry.pid   = pid;
+	entry.state = kRunning;
+	fRunning++;
+}
+
+void TMVA::NeuroBayesProcessPool::StartPending()
+{
+	for (UInt_t id=0; id<fEntries.size() && fRunning<fMaxWorkers; id++) {
+		if (fEntries[id].state == kPending) Start(fEntries[id]);
+	}
+}
+
+Bool_t TMVA::NeuroBayesProcessPool::Reap()
+{
+	// waitpid on our own pids only, other children of the process
+	// (e.g. gSystem->Exec) must not be collected here
+	Bool_t reaped = kFALSE;
+	for (UInt_t id=0; id<fEntries.size(); id++) {
+		Entry& entry = fEntries[id];
+		if (entry.state != kRunning) continue;
+		int status = 0;
+		if (waitpid(entry.pid, &status, WNOHANG) != entry.pid) continue;
+		entry.status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+		entry.stop   = Now();
+		entry.state  = kDone;
+		fRunning--;
+		reaped = kTRUE;
+	}
+	return reaped;
+}
+
+void TMVA::NeuroBayesProcessPool::Poll()
+{
+	if (Reap()) StartPending();
+}
+
+Int_t TMVA::NeuroBayesProcessPool::Wait( Int_t id )
+{
+	StartPending();
+	while (fEntries[id].state == kPending || fEntries[id].state == kRunning) {
+		if (Reap()) StartPending();
+		else usleep(50000);
+		// the job may still be queued behind others
+		if (fEntries[id].state == kPending) StartPending();
+	}
+	return fEntries[id].state == kDone ? fEntries[id].status : -1;
+}
+
+void TMVA::NeuroBayesProcessPool::WaitAll()
+{
+	for (UInt_t id=0; id<fEntries.size(); id++) {
+		if (fEntries[id].state == kPending || fEntries[id].state == kRunning) Wait(id);
+	}
+}
+
+Double_t TMVA::NeuroBayesProcessPool::GetWallTime( Int_t id ) const
+{
+	return fEntries[id].stop - fEntries[id].start;
+}
+
+Double_t TMVA::NeuroBayesProcessPool::Now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return tv.tv_sec + 1.e-6*tv.tv_usec;
+}
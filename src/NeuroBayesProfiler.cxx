@@ -0,0 +1,122 @@
+/****************************************************************
+ * Evaluation latency histograms, see NeuroBayesProfiler.h
+ * *************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include "NeuroBayesProfiler.h"
+
+TMVA::NeuroBayesProfiler::NeuroBayesProfiler( UInt_t nslots )
+{
+	SetNSlots(nslots);
+}
+
+TMVA::NeuroBayesProfiler::~NeuroBayesProfiler()
+{
+	for (UInt_t i=0; i<fSlots.size(); i++) delete fSlots[i];
+}
+
+void TMVA::NeuroBayesProfiler::SetNSlots( UInt_t nslots )
+{
+	// slots are only added, the entries of a smaller pool are kept
+	while (fSlots.size() < nslots) {
+		Slot* slot = new Slot;
+		memset(slot, 0, sizeof(Slot));
+		fSlots.push_back(slot);
+	}
+}
+
+void TMVA::NeuroBayesProfiler::Reset()
+{
+	for (UInt_t i=0; i<fSlots.size(); i++) memset(fSlots[i], 0, sizeof(Slot));
+}
+
+Double_t TMVA::NeuroBayesProfiler::BinCenter( UInt_t bin )
+{
+	if (bin < kSubBins) return bin;
+	const UInt_t e = bin/kSubBins + 1;
+	const Double_t width = Double_t(1ULL << (e - 2));
+	return (kSubBins + bin%kSubBins)*width + 0.5*width;
+}
+
+TMVA::NeuroBayesProfiler::Summary TMVA::NeuroBayesProfiler::GetSummary( EChannel channel ) const
+{
+	Summary summary;
+	memset(&summary, 0, sizeof(summary));
+	std::vector<Long64_t> counts(kNBins, 0);
+	for (UInt_t i=0; i<fSlots.size(); i++) {
+		const Histogram& h = fSlots[i]->fChannels[channel];
+		for (UInt_t bin=0; bin<kNBins; bin++) counts[bin] += h.fCounts[bin];
+		summary.calls   += h.fCalls;
+		summary.entries += h.fEntries;
+		summary.total   += h.fTotal;
+		if (h.fMax > summary.max) summary.max = h.fMax;
+	}
+	if (summary.entries == 0) return summary;
+	summary.mean = summary.total/summary.entries;
+
+	const Double_t fractions[3] = { 0.5, 0.9, 0.99 };
+	Double_t* quantiles[3] = { &summary.p50, &summary.p90, &summary.p99 };
+	Long64_t cumulated = 0;
+	UInt_t iq = 0;
+	for (UInt_t bin=0; bin<kNBins && iq<3; bin++) {
+		cumulated += counts[bin];
+		while (iq < 3 && cumulated >= fractions[iq]*summary.entries) {
+			// a bin center may lie above the exact maximum
+			*quantiles[iq++] = std::min(BinCenter(bin), summary.max);
+		}
+	}
+	return summary;
+}
+
+const char* TMVA::NeuroBayesProfiler::GetChannelName( EChannel channel )
+{
+	switch (channel) {
+	case kGetMvaValue:  return "GetMvaValue";
+	case kGather:       return "gather/event";
+	case kExpert:       return "nb_expert/event";
+	case kBatch:        return "EvaluateBatch";
+	case kReadWeights:  return "ReadWeights";
+	case kCreateExpert: return "CreateExpert";
+	default:            return "unknown";
+	}
+}
+
+std::vector<std::string> TMVA::NeuroBayesProfiler::Format() const
+{
+	std::vector<std::string> lines;
+	char line[256];
+	snprintf(line, sizeof(line), "%-16s %12s %14s %12s %10s %10s %10s %10s %10s",
+		 "channel", "calls", "entries", "total_ms", "mean_us", "p50_us", "p90_us", "p99_us", "max_us");
+	lines.push_back(line);
+	for (Int_t channel=0; channel<kNChannels; channel++) {
+		const Summary s = GetSummary(EChannel(channel));
+		if (s.calls == 0) continue;
+		snprintf(line, sizeof(line), "%-16s %12lld %14lld %12.3f %10.3f %10.3f %10.3f %10.3f %10.3f",
+			 GetChannelName(EChannel(channel)), s.calls, s.entries, 1.e-6*s.total,
+			 1.e-3*s.mean, 1.e-3*s.p50, 1.e-3*s.p90, 1.e-3*s.p99, 1.e-3*s.max);
+		lines.push_back(line);
+	}
+	// balance of the scoring threads
+	if (fSlots.size() > 1) {
+		std::string balance = "nb_expert events per thread:";
+		for (UInt_t i=0; i<fSlots.size(); i++) {
+			snprintf(line, sizeof(line), " %lld", GetEntries(i, kExpert));
+			balance += line;
+		}
+		lines.push_back(balance);
+	}
+	return lines;
+}
+
+Bool_t TMVA::NeuroBayesProfiler::Write( const char* filename, const char* title ) const
+{
+	FILE* out = fopen(filename, "w");
+	if (!out) return kFALSE;
+	fprintf(out, "# %s\n", title);
+	const std::vector<std::string> lines = Format();
+	for (UInt_t i=0; i<lines.size(); i++) fprintf(out, "%s\n", lines[i].c_str());
+	return fclose(out) == 0;
+}
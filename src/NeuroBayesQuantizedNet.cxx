@@ -0,0 +1,264 @@
+/****************************************************************
+ * Reduced-precision inference engine, see NeuroBayesQuantizedNet.h
+ * *************************************************************/
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "NeuroBayesQuantizedNet.h"
+#include "NeuroBayesNativeNet.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NB_QUANTIZED_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+	const UInt_t kPad = 16; // kernel step, one AVX2 register of int16 or two of float
+	const UInt_t kStackStride = 1024; // input strides Evaluate keeps on the stack
+
+	UInt_t PadTo( UInt_t n ) { return (n + kPad - 1)/kPad*kPad; }
+
+	Float_t Sigmoid( Float_t x ) { return 2.f/(1.f + std::exp(-x)) - 1.f; }
+
+	Float_t HalfDotScalar( const UShort_t* w, const Float_t* x, UInt_t n ) {
+		Float_t sum = 0;
+		for (UInt_t i=0; i<n; i++) sum += TMVA::NeuroBayesQuantizedNet::HalfToFloat(w[i])*x[i];
+		return sum;
+	}
+
+	Int_t Int8DotScalar( const signed char* w, const signed char* x, UInt_t n ) {
+		Int_t sum = 0;
+		for (UInt_t i=0; i<n; i++) sum += Int_t(w[i])*Int_t(x[i]);
+		return sum;
+	}
+
+#ifdef NB_QUANTIZED_X86
+	__attribute__((target("avx2,fma,f16c")))
+	Float_t HalfDotAvx2( const UShort_t* w, const Float_t* x, UInt_t n ) {
+		__m256 sum = _mm256_setzero_ps();
+		for (UInt_t i=0; i<n; i+=8) {
+			const __m256 vw = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(w + i)));
+			sum = _mm256_fmadd_ps(vw, _mm256_loadu_ps(x + i), sum);
+		}
+		__m128 s = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+		s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+		s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+		return _mm_cvtss_f32(s);
+	}
+
+	// sign-extend 16 int8 to int16, multiply and add pairs into int32
+	__attribute__((target("avx2")))
+	Int_t Int8DotAvx2( const signed char* w, const signed char* x, UInt_t n ) {
+		__m256i sum = _mm256_setzero_si256();
+		for (UInt_t i=0; i<n; i+=16) {
+			const __m256i vw = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(w + i)));
+			const __m256i vx = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)));
+			sum = _mm256_add_epi32(sum, _mm256_madd_epi16(vw, vx));
+		}
+		__m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+		s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+		s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtsi128_si32(s);
+	}
+#endif
+}
+
+UShort_t TMVA::NeuroBayesQuantizedNet::FloatToHalf( Float_t value )
+{
+	UInt_t f;
+	memcpy(&f, &value, sizeof(f));
+	const UShort_t sign = (f >> 16) & 0x8000;
+	const Int_t exponent = Int_t((f >> 23) & 0xff) - 127 + 15;
+	UInt_t mantissa = f & 0x7fffff;
+	if (((f >> 23) & 0xff) == 0xff) return sign | 0x7c00 | (mantissa ? 0x200 : 0); // inf, nan
+	if (exponent >= 31) return sign | 0x7c00;                                      // overflow
+	if (exponent <= 0) {
+		// subnormal half or zero
+		if (exponent < -10) return sign;
+		mantissa |= 0x800000;
+		const UInt_t shift = 14 - exponent;
+		UInt_t half = mantissa >> shift;
+		const UInt_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1))) half++;
+		return sign | half;
+	}
+	UInt_t half = (UInt_t(exponent) << 10) | (mantissa >> 13);
+	const UInt_t rest = mantissa & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++; // may carry into the exponent, as it should
+	return sign | half;
+}
+
+Float_t TMVA::NeuroBayesQuantizedNet::HalfToFloat( UShort_t half )
+{
+	const UInt_t sign = UInt_t(half & 0x8000) << 16;
+	UInt_t exponent = (half >> 10) & 0x1f;
+	UInt_t mantissa = half & 0x3ff;
+	UInt_t f;
+	if (exponent == 0x1f) f = sign | 0x7f800000 | (mantissa << 13);
+	else if (exponent != 0) f = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+	else if (mantissa == 0) f = sign;
+	else {
+		// subnormal half: normalise
+		exponent = 127 - 15 + 1;
+		while (!(mantissa & 0x400)) { mantissa <<= 1; exponent--; }
+		f = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+	}
+	Float_t value;
+	memcpy(&value, &f, sizeof(value));
+	return value;
+}
+
+TMVA::NeuroBayesQuantizedNet::NeuroBayesQuantizedNet( const NeuroBayesNativeNet& net, EPrecision precision )
+	: fPrecision(precision), fNvar(net.GetNvar()), fNhidden(net.GetNhidden()), fNknots(net.GetNknots()),
+	  fInputStride(PadTo(net.GetNvar() + 1)), fDecorrelate(net.IsDecorrelated())
+{
+	fHasMissing.resize(fNvar);
+	fMissingValue.resize(fNvar);
+	fKnotX.resize(size_t(fNvar)*fNknots);
+	fKnotY.resize(size_t(fNvar)*fNknots);
+	fKnotYScale.resize(fNvar);
+	for (UInt_t ivar=0; ivar<fNvar; ivar++) {
+		fHasMissing[ivar]   = net.HasMissing(ivar);
+		fMissingValue[ivar] = net.GetMissingValue(ivar);
+		const Float_t* kx = net.GetKnotX(ivar);
+		const Float_t* ky = net.GetKnotY(ivar);
+		Float_t ymax = 0;
+		for (UInt_t k=0; k<fNknots; k++) ymax = std::max(ymax, std::fabs(ky[k]));
+		const Float_t scale = ymax > 0 ? ymax/32767.f : 1.f;
+		fKnotYScale[ivar] = scale;
+		for (UInt_t k=0; k<fNknots; k++) {
+			fKnotX[ivar*fNknots + k] = kx[k];
+			fKnotY[ivar*fNknots + k] = Short_t(std::floor(ky[k]/scale + 0.5f));
+		}
+	}
+	if (fDecorrelate) {
+		fDecorr.resize(size_t(fNvar)*fNvar);
+		for (UInt_t i=0; i<fNvar; i++) {
+			for (UInt_t j=0; j<fNvar; j++) fDecorr[i*fNvar + j] = net.GetDecorrelation(i, j);
+		}
+	}
+
+	// one padded row per hidden node, the bias weight in column nvar
+	if (fPrecision == kHalf) {
+		fW1Half.assign(size_t(fNhidden)*fInputStride, 0);
+		for (UInt_t h=0; h<fNhidden; h++) {
+			for (UInt_t i=0; i<=fNvar; i++) fW1Half[h*fInputStride + i] = FloatToHalf(net.GetWeight1(h, i));
+		}
+	}
+	else {
+		fW1Int8.assign(size_t(fNhidden)*fInputStride, 0);
+		fW1Scale.resize(fNhidden);
+		for (UInt_t h=0; h<fNhidden; h++) {
+			Float_t wmax = 0;
+			for (UInt_t i=0; i<=fNvar; i++) wmax = std::max(wmax, std::fabs(net.GetWeight1(h, i)));
+			const Float_t scale = wmax > 0 ? wmax/127.f : 1.f;
+			fW1Scale[h] = scale;
+			for (UInt_t i=0; i<=fNvar; i++) fW1Int8[h*fInputStride + i] = (signed char)(std::floor(net.GetWeight1(h, i)/scale + 0.5f));
+		}
+	}
+	fW2.resize(fNhidden + 1);
+	for (UInt_t h=0; h<=fNhidden; h++) fW2[h] = net.GetWeight2(h);
+
+	fHalfDot = &HalfDotScalar;
+	fInt8Dot = &Int8DotScalar;
+	fKernelName = "scalar";
+#ifdef NB_QUANTIZED_X86
+	__builtin_cpu_init();
+	if (fPrecision == kHalf && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c")) {
+		fHalfDot = &HalfDotAvx2;
+		fKernelName = "AVX2/F16C";
+	}
+	else if (fPrecision == kInt8 && __builtin_cpu_supports("avx2")) {
+		fInt8Dot = &Int8DotAvx2;
+		fKernelName = "AVX2";
+	}
+#endif
+}
+
+size_t TMVA::NeuroBayesQuantizedNet::GetSize() const
+{
+	return fKnotX.size()*sizeof(Float_t) + fKnotY.size()*sizeof(Short_t) + fKnotYScale.size()*sizeof(Float_t)
+		+ fDecorr.size()*sizeof(Float_t) + fW1Half.size()*sizeof(UShort_t) + fW1Int8.size()
+		+ fW1Scale.size()*sizeof(Float_t) + fW2.size()*sizeof(Float_t);
+}
+
+size_t TMVA::NeuroBayesQuantizedNet::GetSize( const NeuroBayesNativeNet& net )
+{
+	const size_t nvar = net.GetNvar();
+	return sizeof(Float_t)*(2*nvar*net.GetNknots() + (net.IsDecorrelated() ? nvar*nvar : 0)
+				+ (nvar + 1)*net.GetNhidden() + net.GetNhidden() + 1);
+}
+
+void TMVA::NeuroBayesQuantizedNet::Preprocess( const Double_t* input, Float_t* x, Float_t* scratch ) const
+{
+	// as NeuroBayesNativeNet::Preprocess, with the packed tables
+	for (UInt_t ivar=0; ivar<fNvar; ivar++) {
+		const Float_t v = input[ivar];
+		if (fHasMissing[ivar] && v == fMissingValue[ivar]) { x[ivar] = 0; continue; }
+		if (fNknots == 0) { x[ivar] = v; continue; }
+
+		const Float_t* kx = &fKnotX[ivar*fNknots];
+		const Short_t* ky = &fKnotY[ivar*fNknots];
+		Float_t y;
+		if (v <= kx[0]) y = ky[0];
+		else if (v >= kx[fNknots-1]) y = ky[fNknots-1];
+		else {
+			const UInt_t k = std::upper_bound(kx, kx + fNknots, v) - kx - 1;
+			const Float_t dx = kx[k+1] - kx[k];
+			y = dx > 0 ? ky[k] + (ky[k+1] - ky[k])*(v - kx[k])/dx : ky[k];
+		}
+		x[ivar] = y*fKnotYScale[ivar];
+	}
+	if (fDecorrelate) {
+		std::copy(x, x + fNvar, scratch);
+		for (UInt_t i=0; i<fNvar; i++) {
+			Float_t s = 0;
+			for (UInt_t j=0; j<fNvar; j++) s += fDecorr[i*fNvar + j]*scratch[j];
+			x[i] = s;
+		}
+	}
+	x[fNvar] = 1; // bias node
+	std::fill(x + fNvar + 1, x + fInputStride, 0.f);
+}
+
+void TMVA::NeuroBayesQuantizedNet::Evaluate( const Double_t* inputs, Long64_t nevents, Double_t* values ) const
+{
+	// scratch on the stack unless the network is unusually wide, as in
+	// NeuroBayesNativeNet::Evaluate
+	Float_t local[2*kStackStride];
+	signed char localq[kStackStride];
+	std::vector<Float_t> heap;
+	std::vector<signed char> heapq;
+	Float_t* x = local;
+	signed char* xq = localq;
+	if (fInputStride > kStackStride) {
+		heap.resize(2*fInputStride);
+		heapq.resize(fInputStride);
+		x = &heap[0];
+		xq = &heapq[0];
+	}
+	Float_t* scratch = x + fInputStride;
+	for (Long64_t ievt=0; ievt<nevents; ievt++) {
+		Preprocess(inputs + ievt*fNvar, x, scratch);
+
+		Float_t xscale = 0;
+		if (fPrecision == kInt8) {
+			Float_t xmax = 0;
+			for (UInt_t i=0; i<=fNvar; i++) xmax = std::max(xmax, std::fabs(x[i]));
+			xscale = xmax/127.f;
+			const Float_t inverse = xmax > 0 ? 127.f/xmax : 0.f;
+			for (UInt_t i=0; i<fInputStride; i++) xq[i] = (signed char)(std::floor(x[i]*inverse + 0.5f));
+		}
+
+		Float_t out = fW2[fNhidden];
+		for (UInt_t h=0; h<fNhidden; h++) {
+			const Float_t a = fPrecision == kHalf
+				? fHalfDot(&fW1Half[h*fInputStride], x, fInputStride)
+				: fInt8Dot(&fW1Int8[h*fInputStride], xq, fInputStride)*fW1Scale[h]*xscale;
+			out += fW2[h]*Sigmoid(a);
+		}
+		values[ievt] = Sigmoid(out);
+	}
+}
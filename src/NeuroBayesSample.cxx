@@ -0,0 +1,182 @@
+/****************************************************************
+ * In-memory NeuroBayes training inputs, see NeuroBayesSample.h
+ * *************************************************************/
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "NeuroBayesSample.h"
+
+namespace {
+	const char kCacheMagic[8] = { 'N', 'B', 'C', 'A', 'C', 'H', 'E', '1' };
+
+	struct CacheHeader {
+		char      magic[8];
+		ULong64_t key;
+		ULong64_t nvar;
+		ULong64_t nevents;
+	};
+
+	struct ByResponse {
+		const std::vector<Double_t>& fResponses;
+		ByResponse( const std::vector<Double_t>& responses ) : fResponses(responses) {}
+		bool operator()( UInt_t a, UInt_t b ) const { return fResponses[a] < fResponses[b]; }
+	};
+}
+
+TMVA::NeuroBayesSample::NeuroBayesSample( UInt_t nvar )
+	: fNvar(nvar), fNevents(0), fInputsData(0), fTargetsData(0), fWeightsData(0),
+	  fMapping(0), fMappingSize(0)
+{
+}
+
+TMVA::NeuroBayesSample::~NeuroBayesSample()
+{
+	Unmap();
+}
+
+void TMVA::NeuroBayesSample::Reserve( Long64_t nevents )
+{
+	fInputs.reserve(nevents*fNvar);
+	fTargets.reserve(nevents);
+	fWeights.reserve(nevents);
+}
+
+void TMVA::NeuroBayesSample::AddEvent( const Float_t* inputs, Float_t target, Float_t weight )
+{
+	Unmap();
+	fInputs.insert(fInputs.end(), inputs, inputs + fNvar);
+	fTargets.push_back(target);
+	fWeights.push_back(weight);
+	fNevents++;
+	fInputsData  = fInputs.empty() ? 0 : &fInputs[0];
+	fTargetsData = &fTargets[0];
+	fWeightsData = &fWeights[0];
+}
+
+Bool_t TMVA::NeuroBayesSample::WriteCache( const char* filename, ULong64_t key ) const
+{
+	// written under a temporary name and renamed, so a concurrent reader
+	// never maps a half-written file
+	CacheHeader header;
+	memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+	header.key     = key;
+	header.nvar    = fNvar;
+	header.nevents = fNevents;
+
+	char tmpname[4096];
+	snprintf(tmpname, sizeof(tmpname), "%s.tmp%d", filename, Int_t(getpid()));
+	FILE* out = fopen(tmpname, "wb");
+	if (!out) return kFALSE;
+	Bool_t ok = fwrite(&header, sizeof(header), 1, out) == 1;
+	ok = ok && fwrite(fInputsData,  sizeof(Float_t), fNevents*fNvar, out) == size_t(fNevents*fNvar);
+	ok = ok && fwrite(fTargetsData, sizeof(Float_t), fNevents, out) == size_t(fNevents);
+	ok = ok && fwrite(fWeightsData, sizeof(Float_t), fNevents, out) == size_t(fNevents);
+	ok = (fclose(out) == 0) && ok;
+	if (ok) ok = rename(tmpname, filename) == 0;
+	if (!ok) unlink(tmpname);
+	return ok;
+}
+
+Bool_t TMVA::NeuroBayesSample::MapCache( const char* filename, ULong64_t key )
+{
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) return kFALSE;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(CacheHeader)) { close(fd); return kFALSE; }
+	void* mapping = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) return kFALSE;
+
+	const CacheHeader* header = static_cast<const CacheHeader*>(mapping);
+	const size_t expected = sizeof(CacheHeader) + sizeof(Float_t)*header->nevents*(header->nvar + 2);
+	if (memcmp(header->magic, kCacheMagic, sizeof(kCacheMagic)) != 0 || header->key != key
+	    || header->nvar != fNvar || size_t(st.st_size) != expected) {
+		munmap(mapping, st.st_size);
+		return kFALSE;
+	}
+	// the Teacher is fed front to back
+	madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+
+	Unmap();
+	fInputs.clear();
+	fTargets.clear();
+	fWeights.clear();
+	fMapping     = mapping;
+	fMappingSize = st.st_size;
+	fNevents     = header->nevents;
+	fInputsData  = reinterpret_cast<const Float_t*>(header + 1);
+	fTargetsData = fInputsData + fNevents*fNvar;
+	fWeightsData = fTargetsData + fNevents;
+	return kTRUE;
+}
+
+void TMVA::NeuroBayesSample::Unmap()
+{
+	if (!fMapping) return;
+	munmap(fMapping, fMappingSize);
+	fMapping = 0;
+	fMappingSize = 0;
+	fNevents = 0;
+	fInputsData = fTargetsData = fWeightsData = 0;
+}
+
+ULong64_t TMVA::NeuroBayesSample::Hash( const void* data, size_t length, ULong64_t hash )
+{
+	const UChar_t* bytes = static_cast<const UChar_t*>(data);
+	for (size_t i=0; i<length; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+Bool_t TMVA::NeuroBayesSample::InFraction( Long64_t ievt, Double_t fraction )
+{
+	return Long64_t((ievt + 1)*fraction) != Long64_t(ievt*fraction);
+}
+
+Double_t TMVA::NeuroBayesSample::GetROCIntegral( const std::vector<Long64_t>& events, const std::vector<Double_t>& responses ) const
+{
+	// sweep the cut from low to high response: every signal event
+	// outranks the background weight below it, ties count half
+	std::vector<UInt_t> order(events.size());
+	for (UInt_t i=0; i<order.size(); i++) order[i] = i;
+	std::sort(order.begin(), order.end(), ByResponse(responses));
+
+	Double_t sumS = 0, sumB = 0, area = 0;
+	for (UInt_t i=0; i<order.size(); ) {
+		Double_t tieS = 0, tieB = 0;
+		UInt_t j = i;
+		for (; j<order.size() && responses[order[j]] == responses[order[i]]; j++) {
+			const Long64_t ievt = events[order[j]];
+			if (GetTarget(ievt) > 0.5) tieS += GetWeight(ievt);
+			else                       tieB += GetWeight(ievt);
+		}
+		area += tieS*(sumB + 0.5*tieB);
+		sumS += tieS;
+		sumB += tieB;
+		i = j;
+	}
+	return (sumS > 0 && sumB > 0) ? area/(sumS*sumB) : 0.5;
+}
+
+Double_t TMVA::NeuroBayesSample::GetEntropyLoss( const std::vector<Long64_t>& events, const std::vector<Double_t>& responses ) const
+{
+	const Double_t eps = 1.e-7;
+	Double_t loss = 0, sumw = 0;
+	for (UInt_t i=0; i<events.size(); i++) {
+		const Long64_t ievt = events[i];
+		const Double_t p = std::min(std::max(0.5*(responses[i] + 1), eps), 1 - eps);
+		const Double_t w = GetWeight(ievt);
+		loss -= w*(GetTarget(ievt) > 0.5 ? std::log(p) : std::log(1 - p));
+		sumw += w;
+	}
+	return sumw > 0 ? loss/sumw : 0;
+}
@@ -0,0 +1,94 @@
+/****************************************************************
+ * Persistent pthread pool for multi-threaded NeuroBayes scoring,
+ * see NeuroBayesThreadPool.h
+ * *************************************************************/
+
+#include "NeuroBayesThreadPool.h"
+
+namespace {
+	struct WorkerStart {
+		TMVA::NeuroBayesThreadPool* pool;
+		UInt_t islot;
+	};
+}
+
+TMVA::NeuroBayesThreadPool::NeuroBayesThreadPool( UInt_t nthreads )
+	: fTask(0), fGeneration(0), fPending(0), fStop(kFALSE)
+{
+	pthread_mutex_init(&fMutex, 0);
+	pthread_cond_init(&fStart, 0);
+	pthread_cond_init(&fDone, 0);
+
+	for (UInt_t islot=1; islot<nthreads; islot++) {
+		WorkerStart* start = new WorkerStart;
+		start->pool  = this;
+		start->islot = islot;
+		pthread_t thread;
+		if (pthread_create(&thread, 0, &NeuroBayesThreadPool::WorkerLoop, start) != 0) {
+			delete start;
+			break; // run with the threads we got
+		}
+		fWorkers.push_back(thread);
+	}
+}
+
+TMVA::NeuroBayesThreadPool::~NeuroBayesThreadPool()
+{
+	pthread_mutex_lock(&fMutex);
+	fStop = kTRUE;
+	pthread_cond_broadcast(&fStart);
+	pthread_mutex_unlock(&fMutex);
+	for (UInt_t i=0; i<fWorkers.size(); i++) pthread_join(fWorkers[i], 0);
+
+	pthread_cond_destroy(&fDone);
+	pthread_cond_destroy(&fStart);
+	pthread_mutex_destroy(&fMutex);
+}
+
+void TMVA::NeuroBayesThreadPool::Run( Task* task )
+{
+	const UInt_t nslots = GetNThreads();
+	pthread_mutex_lock(&fMutex);
+	fTask = task;
+	fPending = fWorkers.size();
+	fGeneration++;
+	pthread_cond_broadcast(&fStart);
+	pthread_mutex_unlock(&fMutex);
+
+	task->Run(0, nslots);
+
+	pthread_mutex_lock(&fMutex);
+	while (fPending > 0) pthread_cond_wait(&fDone, &fMutex);
+	fTask = 0;
+	pthread_mutex_unlock(&fMutex);
+}
+
+void* TMVA::NeuroBayesThreadPool::WorkerLoop( void* arg )
+{
+	WorkerStart* start = static_cast<WorkerStart*>(arg);
+	NeuroBayesThreadPool* pool = start->pool;
+	UInt_t islot = start->islot;
+	delete start;
+	pool->WorkerLoop(islot);
+	return 0;
+}
+
+void TMVA::NeuroBayesThreadPool::WorkerLoop( UInt_t islot )
+{
+	ULong_t seen = 0;
+	pthread_mutex_lock(&fMutex);
+	for (;;) {
+		while (!fStop && fGeneration == seen) pthread_cond_wait(&fStart, &fMutex);
+		if (fStop) break;
+		seen = fGeneration;
+		Task* task = fTask;
+		const UInt_t nslots = GetNThreads();
+		pthread_mutex_unlock(&fMutex);
+
+		task->Run(islot, nslots);
+
+		pthread_mutex_lock(&fMutex);
+		if (--fPending == 0) pthread_cond_signal(&fDone);
+	}
+	pthread_mutex_unlock(&fMutex);
+}
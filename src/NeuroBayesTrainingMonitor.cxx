@@ -0,0 +1,222 @@
+/****************************************************************
+ * Capture of the NeuroBayes Teacher output during training,
+ * see NeuroBayesTrainingMonitor.h
+ * *************************************************************/
+
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <ctime>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "NeuroBayesTrainingMonitor.h"
+
+namespace {
+	const Double_t kFlushInterval = 0.1; // s between flushes of stdout by the reader
+
+	std::string Lower( const std::string& word ) {
+		std::string lower(word);
+		for (size_t i=0; i<lower.size(); i++) lower[i] = tolower(lower[i]);
+		return lower;
+	}
+
+	Bool_t ToNumber( const std::string& word, Double_t& value ) {
+		if (word.empty()) return kFALSE;
+		char* end = 0;
+		value = strtod(word.c_str(), &end);
+		return *end == '\0';
+	}
+}
+
+TMVA::NeuroBayesTrainingMonitor::NeuroBayesTrainingMonitor()
+	: fPipe(-1), fOriginal(-1), fLog(0), fMetrics(0), fFirstIter(0), fObserver(0),
+	  fRunning(kFALSE), fLastWall(0), fLastCpu(0)
+{
+}
+
+TMVA::NeuroBayesTrainingMonitor::~NeuroBayesTrainingMonitor()
+{
+	Stop();
+}
+
+Bool_t TMVA::NeuroBayesTrainingMonitor::Start( const char* logFile, const char* metricsFile, Bool_t append,
+					       Int_t firstIter, Observer* observer )
+{
+	if (fRunning) return kFALSE;
+	int fds[2];
+	if (pipe(fds) != 0) return kFALSE;
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+	fLog = fopen(logFile, append ? "a" : "w");
+	fMetrics = metricsFile ? fopen(metricsFile, append ? "a" : "w") : 0;
+	if (fMetrics && ftell(fMetrics) == 0) {
+		fprintf(fMetrics, "iteration,loss,wall_s,cpu_s\n");
+		fflush(fMetrics);
+	}
+	fPipe      = fds[0];
+	fFirstIter = firstIter;
+	fObserver  = observer;
+	fIterations.clear();
+	fLastWall  = WallTime();
+	fLastCpu   = CpuTime();
+
+	// output pending in the stdio buffer belongs to the terminal, what is
+	// printed from here on to the pipe; the reader flushes stdout from now on
+	fflush(stdout);
+	fOriginal = dup(fileno(stdout));
+	dup2(fds[1], fileno(stdout));
+	close(fds[1]);
+
+	if (pthread_create(&fReader, 0, &NeuroBayesTrainingMonitor::ReaderLoop, this) != 0) {
+		// no reader: undo the redirection, the Teacher prints as before
+		dup2(fOriginal, fileno(stdout));
+		close(fOriginal);
+		close(fPipe);
+		if (fLog) fclose(fLog);
+		if (fMetrics) fclose(fMetrics);
+		fLog = fMetrics = 0;
+		return kFALSE;
+	}
+	fRunning = kTRUE;
+	return kTRUE;
+}
+
+void TMVA::NeuroBayesTrainingMonitor::Stop()
+{
+	if (!fRunning) return;
+	// restoring stdout closes the last write end, the reader gets EOF
+	fflush(stdout);
+	dup2(fOriginal, fileno(stdout));
+	close(fOriginal);
+	pthread_join(fReader, 0);
+	close(fPipe);
+	if (fLog) fclose(fLog);
+	if (fMetrics) fclose(fMetrics);
+	fLog = fMetrics = 0;
+	fRunning = kFALSE;
+}
+
+void* TMVA::NeuroBayesTrainingMonitor::ReaderLoop( void* monitor )
+{
+	static_cast<NeuroBayesTrainingMonitor*>(monitor)->ReadPipe();
+	return 0;
+}
+
+void TMVA::NeuroBayesTrainingMonitor::ReadPipe()
+{
+	// stdout keeps its buffering mode: fully buffered if the job writes to a
+	// file, and setvbuf is only defined before the first output. Flushing it
+	// at a fixed interval (stdio locks the stream) delivers the lines within
+	// kFlushInterval, whatever the mode and however much the Teacher prints.
+	char buffer[4096];
+	std::string line;
+	Double_t nextFlush = WallTime() + kFlushInterval;
+	for (;;) {
+		const Double_t now = WallTime();
+		if (now >= nextFlush) {
+			fflush(stdout);
+			nextFlush = now + kFlushInterval;
+		}
+		struct pollfd fd;
+		fd.fd = fPipe;
+		fd.events = POLLIN;
+		const int ready = poll(&fd, 1, Int_t(1.e3*(nextFlush - now)) + 1);
+		if (ready < 0 && errno == EINTR) continue;
+		if (ready == 0) continue;
+		const ssize_t n = read(fPipe, buffer, sizeof(buffer));
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) break;
+		if (fLog) {
+			fwrite(buffer, 1, n, fLog);
+			fflush(fLog);
+		}
+		// the Teacher may redraw a line with '\r'
+		for (ssize_t i=0; i<n; i++) {
+			if (buffer[i] == '\n' || buffer[i] == '\r') {
+				ProcessLine(line);
+				line.clear();
+			}
+			else line += buffer[i];
+		}
+	}
+	if (!line.empty()) ProcessLine(line);
+}
+
+void TMVA::NeuroBayesTrainingMonitor::ProcessLine( const std::string& line )
+{
+	Int_t iter;
+	Bool_t hasLoss;
+	Double_t loss;
+	if (!ParseIteration(line, iter, hasLoss, loss)) return;
+
+	const Double_t wall = WallTime();
+	const Double_t cpu  = CpuTime();
+	Iteration iteration;
+	iteration.iter = fFirstIter + iter;
+	iteration.hasLoss = hasLoss;
+	iteration.loss = loss;
+	iteration.wall = wall - fLastWall;
+	iteration.cpu  = cpu - fLastCpu;
+	fLastWall = wall;
+	fLastCpu  = cpu;
+	fIterations.push_back(iteration);
+
+	if (fMetrics) {
+		fprintf(fMetrics, "%d,", iteration.iter);
+		if (hasLoss) fprintf(fMetrics, "%.8g", loss);
+		fprintf(fMetrics, ",%.6f,%.6f\n", iteration.wall, iteration.cpu);
+		fflush(fMetrics);
+	}
+	if (fObserver) fObserver->NewIteration(iteration);
+}
+
+Bool_t TMVA::NeuroBayesTrainingMonitor::ParseIteration( const std::string& line, Int_t& iter, Bool_t& hasLoss, Double_t& loss )
+{
+	std::vector<std::string> words;
+	std::string word;
+	for (size_t i=0; i<=line.size(); i++) {
+		const char c = i < line.size() ? line[i] : ' ';
+		if (isspace(c) || c == ':' || c == '=' || c == ',') {
+			if (!word.empty()) words.push_back(word);
+			word.clear();
+		}
+		else word += c;
+	}
+
+	Bool_t found = kFALSE;
+	hasLoss = kFALSE;
+	loss = 0;
+	Double_t value;
+	for (size_t i=0; i+1<words.size(); i++) {
+		const std::string lower = Lower(words[i]);
+		const Bool_t iterWord = lower == "iter" || lower == "iter." || lower == "iteration";
+		if (!found && iterWord && ToNumber(words[i+1], value) && value >= 0 && value == Int_t(value)) {
+			iter  = Int_t(value);
+			found = kTRUE;
+		}
+		else if (!hasLoss && (lower.find("loss") != std::string::npos || lower.find("entropy") != std::string::npos
+					   || lower.find("error") != std::string::npos) && ToNumber(words[i+1], value)) {
+			hasLoss = kTRUE;
+			loss = value;
+		}
+	}
+	return found;
+}
+
+Double_t TMVA::NeuroBayesTrainingMonitor::WallTime()
+{
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return tv.tv_sec + 1.e-6*tv.tv_usec;
+}
+
+Double_t TMVA::NeuroBayesTrainingMonitor::CpuTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + 1.e-9*ts.tv_nsec;
+}
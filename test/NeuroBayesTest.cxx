@@ -0,0 +1,472 @@
+/****************************************************************
+ * Unit tests of the helpers of MethodNeuroBayes that need neither
+ * NeuroBayes nor the ROOT libraries (only the ROOT headers), run
+ * with "make test".
+ * *************************************************************/
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "NeuroBayesDownsampler.h"
+#include "NeuroBayesInputStatistics.h"
+#include "NeuroBayesNativeNet.h"
+#include "NeuroBayesProfiler.h"
+#include "NeuroBayesQuantizedNet.h"
+
+namespace {
+	Int_t gFailures = 0;
+	Int_t gChecks   = 0;
+
+#define NB_CHECK( condition ) Check((condition), #condition, __FILE__, __LINE__)
+#define NB_CHECK_CLOSE( a, b, tolerance ) CheckClose((a), (b), (tolerance), #a, __FILE__, __LINE__)
+
+	void Check( Bool_t ok, const char* what, const char* file, Int_t line ) {
+		gChecks++;
+		if (ok) return;
+		gFailures++;
+		printf("%s:%d: FAILED %s\n", file, line, what);
+	}
+
+	void CheckClose( Double_t a, Double_t b, Double_t tolerance, const char* what, const char* file, Int_t line ) {
+		gChecks++;
+		if (std::fabs(a - b) <= tolerance) return;
+		gFailures++;
+		printf("%s:%d: FAILED %s = %.9g, expected %.9g +- %.3g\n", file, line, what, a, b, tolerance);
+	}
+
+	// reproducible uniform numbers in [0,1)
+	struct Lcg {
+		UInt_t state;
+		Lcg( UInt_t seed ) : state(seed) {}
+		Double_t Uniform() { state = state*1103515245u + 12345u; return (state >> 8)/Double_t(1 << 24); }
+	};
+
+	// expertise in the layout of NeuroBayesNativeNet.cxx with random
+	// tables, decorrelation and weights
+	std::vector<Float_t> MakeExpertise( UInt_t nvar, UInt_t nhidden, UInt_t nknots, Bool_t decorrelate, UInt_t seed ) {
+		Lcg lcg(seed);
+		std::vector<Float_t> e;
+		e.push_back(nvar + 1);
+		e.push_back(nhidden + 1);
+		e.push_back(1);
+		e.push_back(12);
+		e.push_back(nknots);
+		e.push_back(decorrelate ? 1 : 0);
+		for (UInt_t ivar=0; ivar<nvar; ivar++) {
+			e.push_back(12);
+			e.push_back(ivar == 0 ? 1 : 0);  // first variable has a missing value
+			e.push_back(-999);
+			Float_t x = -2;
+			for (UInt_t k=0; k<nknots; k++) e.push_back(x += 0.1 + lcg.Uniform()); // increasing knots
+			for (UInt_t k=0; k<nknots; k++) e.push_back(-1. + 2.*k/std::max<Int_t>(nknots - 1, 1));
+		}
+		if (decorrelate) {
+			for (UInt_t i=0; i<nvar*nvar; i++) e.push_back(lcg.Uniform() - 0.5 + (i % (nvar + 1) == 0 ? 1 : 0));
+		}
+		for (UInt_t i=0; i<nhidden*(nvar + 1); i++) e.push_back(2*lcg.Uniform() - 1);
+		for (UInt_t i=0; i<nhidden + 1; i++) e.push_back(2*lcg.Uniform() - 1);
+		return e;
+	}
+
+	Double_t Sigmoid( Double_t x ) { return 2./(1. + std::exp(-x)) - 1.; }
+
+	// straightforward double precision evaluation of MakeExpertise's layout
+	Double_t Reference( const std::vector<Float_t>& e, const Double_t* input ) {
+		const UInt_t nvar = UInt_t(e[0]) - 1, nhidden = UInt_t(e[1]) - 1, nknots = UInt_t(e[4]);
+		const Bool_t decorrelate = e[5] != 0;
+		const Float_t* p = &e[6];
+		std::vector<Double_t> x(nvar + 1, 1.);
+		for (UInt_t ivar=0; ivar<nvar; ivar++, p += 3 + 2*nknots) {
+			const Float_t* kx = p + 3;
+			const Float_t* ky = p + 3 + nknots;
+			const Float_t v = input[ivar];
+			if (p[1] != 0 && v == p[2]) x[ivar] = 0;
+			else if (nknots == 0) x[ivar] = v;
+			else if (v <= kx[0]) x[ivar] = ky[0];
+			else if (v >= kx[nknots-1]) x[ivar] = ky[nknots-1];
+			else {
+				UInt_t k = 0;
+				while (kx[k+1] <= v) k++;
+				x[ivar] = ky[k] + (ky[k+1] - ky[k])*(v - kx[k])/(kx[k+1] - kx[k]);
+			}
+		}
+		if (decorrelate) {
+			std::vector<Double_t> y(nvar, 0.);
+			for (UInt_t i=0; i<nvar; i++) for (UInt_t j=0; j<nvar; j++) y[i] += p[i*nvar + j]*x[j];
+			std::copy(y.begin(), y.end(), x.begin());
+			p += nvar*nvar;
+		}
+		const Float_t* w2 = p + nhidden*(nvar + 1);
+		Double_t out = w2[nhidden];
+		for (UInt_t h=0; h<nhidden; h++) {
+			Double_t a = 0;
+			for (UInt_t i=0; i<=nvar; i++) a += p[h*(nvar + 1) + i]*x[i];
+			out += w2[h]*Sigmoid(a);
+		}
+		return Sigmoid(out);
+	}
+
+	std::vector<Double_t> MakeInputs( UInt_t nvar, Long64_t nevents, UInt_t seed ) {
+		Lcg lcg(seed);
+		std::vector<Double_t> inputs(nevents*nvar);
+		for (size_t i=0; i<inputs.size(); i++) inputs[i] = 8*lcg.Uniform() - 3;
+		inputs[0] = -999; // missing value of variable 0
+		return inputs;
+	}
+
+	void TestNativeNet() {
+		// sizes around the SIMD padding and the tile of 32 events; the
+		// largest one needs more scratch space than Evaluate has on the stack
+		const UInt_t nvars[5] = { 1, 5, 16, 23, 200 };
+		for (UInt_t t=0; t<5; t++) {
+			for (Int_t decorrelate=0; decorrelate<2; decorrelate++) {
+				const UInt_t nvar = nvars[t];
+				const std::vector<Float_t> expertise = MakeExpertise(nvar, nvar + 1, 9, decorrelate, 17 + t);
+				TMVA::NeuroBayesNativeNet net;
+				NB_CHECK(net.SetExpertise(expertise));
+				NB_CHECK(net.GetNvar() == nvar);
+				NB_CHECK(net.GetNhidden() == nvar + 1);
+				NB_CHECK(net.IsDecorrelated() == Bool_t(decorrelate));
+
+				const Long64_t nevents = 75;
+				const std::vector<Double_t> inputs = MakeInputs(nvar, nevents, 5 + t);
+				std::vector<Double_t> values(nevents);
+				net.Evaluate(&inputs[0], nevents, &values[0]);
+				for (Long64_t ievt=0; ievt<nevents; ievt++) {
+					NB_CHECK_CLOSE(values[ievt], Reference(expertise, &inputs[ievt*nvar]), 1.e-5);
+				}
+				// a block gives the same as single events
+				Double_t single;
+				net.Evaluate(&inputs[(nevents-1)*nvar], 1, &single);
+				NB_CHECK(single == values[nevents-1]);
+			}
+		}
+
+		// no preprocessing tables: the raw inputs enter the network
+		const std::vector<Float_t> raw = MakeExpertise(3, 4, 0, kFALSE, 3);
+		TMVA::NeuroBayesNativeNet rawNet;
+		NB_CHECK(rawNet.SetExpertise(raw));
+		const Double_t input[3] = { 0.3, -0.2, 0.7 };
+		Double_t value;
+		rawNet.Evaluate(input, 1, &value);
+		NB_CHECK_CLOSE(value, Reference(raw, input), 1.e-5);
+	}
+
+	void TestNativeNetRejects() {
+		// anything that does not match the layout exactly is refused
+		TMVA::NeuroBayesNativeNet net;
+		std::vector<Float_t> e = MakeExpertise(4, 5, 7, kTRUE, 1);
+		std::vector<Float_t> shorter(e.begin(), e.end() - 1);
+		NB_CHECK(!net.SetExpertise(shorter));
+		std::vector<Float_t> longer(e);
+		longer.push_back(0);
+		NB_CHECK(!net.SetExpertise(longer));
+		std::vector<Float_t> regression(e);
+		regression[2] = 2; // two output nodes
+		NB_CHECK(!net.SetExpertise(regression));
+		NB_CHECK(!net.SetExpertise(std::vector<Float_t>(3, 1.f)));
+		NB_CHECK(!net.SetExpertise(std::vector<Float_t>()));
+	}
+
+	UInt_t FloatBits( Float_t value ) {
+		UInt_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	void TestHalf() {
+		using TMVA::NeuroBayesQuantizedNet;
+		NB_CHECK(NeuroBayesQuantizedNet::FloatToHalf(0.f) == 0x0000);
+		NB_CHECK(NeuroBayesQuantizedNet::FloatToHalf(-0.f) == 0x8000);
+		NB_CHECK(NeuroBayesQuantizedNet::FloatToHalf(1.f) == 0x3C00);
+		NB_CHECK(NeuroBayesQuantizedNet::FloatToHalf(-2.f) == 0xC000);
+		NB_CHECK(NeuroBayesQuantizedNet::FloatToHalf(65504.f) == 0x7BFF);   // largest finite
+		NB_CHECK(NeuroBayesQuantizedNet::FloatToHalf(65520.f) == 0x7C00);   // rounds up to infinity
+		NB_CHECK(NeuroBayesQuantizedNet::FloatToHalf(1.e6f) == 0x7C00);
+		NB_CHECK(NeuroBayesQuantizedNet::FloatToHalf(std::numeric_limits<Float_t>::infinity()) == 0x7C00);
+		const UShort_t nan = NeuroBayesQuantizedNet::FloatToHalf(std::numeric_limits<Float_t>::quiet_NaN());
+		NB_CHECK((nan & 0x7C00) == 0x7C00 && (nan & 0x03FF) != 0);
+		// subnormals and round to nearest even
+		NB_CHECK(NeuroBayesQuantizedNet::FloatToHalf(std::ldexp(1.f, -24)) == 0x0001);
+		NB_CHECK(NeuroBayesQuantizedNet::FloatToHalf(std::ldexp(1.f, -25)) == 0x0000);
+		NB_CHECK(NeuroBayesQuantizedNet::FloatToHalf(std::ldexp(3.f, -25)) == 0x0002);
+		NB_CHECK(NeuroBayesQuantizedNet::FloatToHalf(std::ldexp(1.f, -14)) == 0x0400); // smallest normal
+		NB_CHECK(NeuroBayesQuantizedNet::FloatToHalf(1.f + std::ldexp(1.f, -11)) == 0x3C00);
+		NB_CHECK(NeuroBayesQuantizedNet::FloatToHalf(1.f + std::ldexp(3.f, -11)) == 0x3C02);
+		NB_CHECK(NeuroBayesQuantizedNet::FloatToHalf(1.f + std::ldexp(1.f, -11) + std::ldexp(1.f, -20)) == 0x3C01);
+
+		// every half survives the round trip through float, NaNs stay NaN
+		Int_t mismatches = 0;
+		for (UInt_t half=0; half<0x10000; half++) {
+			const Float_t value = NeuroBayesQuantizedNet::HalfToFloat(half);
+			if ((half & 0x7C00) == 0x7C00 && (half & 0x03FF)) {
+				if (value == value) mismatches++;
+			}
+			else if (NeuroBayesQuantizedNet::FloatToHalf(value) != half) mismatches++;
+		}
+		NB_CHECK(mismatches == 0);
+		NB_CHECK(FloatBits(NeuroBayesQuantizedNet::HalfToFloat(0x8000)) == 0x80000000u);
+		NB_CHECK(NeuroBayesQuantizedNet::HalfToFloat(0x0001) == std::ldexp(1.f, -24));
+		NB_CHECK(NeuroBayesQuantizedNet::HalfToFloat(0x7BFF) == 65504.f);
+	}
+
+	void TestQuantizedNet() {
+		// reduced precision stays close to the float engine
+		const UInt_t nvar = 12;
+		const std::vector<Float_t> expertise = MakeExpertise(nvar, 15, 9, kTRUE, 23);
+		TMVA::NeuroBayesNativeNet net;
+		NB_CHECK(net.SetExpertise(expertise));
+		const Long64_t nevents = 200;
+		const std::vector<Double_t> inputs = MakeInputs(nvar, nevents, 29);
+		std::vector<Double_t> reference(nevents), values(nevents);
+		net.Evaluate(&inputs[0], nevents, &reference[0]);
+
+		const TMVA::NeuroBayesQuantizedNet::EPrecision precisions[2] = { TMVA::NeuroBayesQuantizedNet::kHalf, TMVA::NeuroBayesQuantizedNet::kInt8 };
+		const Double_t tolerances[2] = { 5.e-3, 5.e-2 };
+		for (UInt_t i=0; i<2; i++) {
+			TMVA::NeuroBayesQuantizedNet quantized(net, precisions[i]);
+			NB_CHECK(quantized.GetNvar() == nvar);
+			NB_CHECK(quantized.GetSize() < TMVA::NeuroBayesQuantizedNet::GetSize(net));
+			quantized.Evaluate(&inputs[0], nevents, &values[0]);
+			Double_t maxdev = 0;
+			for (Long64_t ievt=0; ievt<nevents; ievt++) maxdev = std::max(maxdev, std::fabs(values[ievt] - reference[ievt]));
+			NB_CHECK_CLOSE(maxdev, 0, tolerances[i]);
+		}
+	}
+
+	void TestDownsampler() {
+		using TMVA::NeuroBayesDownsampler;
+		Long64_t signalQuota, backgroundQuota;
+		NeuroBayesDownsampler::SplitTarget(1000, 200, 100000, signalQuota, backgroundQuota);
+		NB_CHECK(signalQuota == 200 && backgroundQuota == 800);
+		NeuroBayesDownsampler::SplitTarget(1000, 100000, 300, signalQuota, backgroundQuota);
+		NB_CHECK(signalQuota == 700 && backgroundQuota == 300);
+		NeuroBayesDownsampler::SplitTarget(1001, 5000, 5000, signalQuota, backgroundQuota);
+		NB_CHECK(signalQuota + backgroundQuota == 1001 && signalQuota == 500);
+		NeuroBayesDownsampler::SplitTarget(1000, 100, 200, signalQuota, backgroundQuota);
+		NB_CHECK(signalQuota == 100 && backgroundQuota == 200);
+
+		// 20000 signal and 60000 background events, input 0 holds the index
+		const UInt_t nvar = 2;
+		const Long64_t nevents = 80000;
+		NeuroBayesDownsampler sampler(nvar, 1000, 3000, 11);
+		Double_t sumw[2] = { 0, 0 };
+		std::vector<Long64_t> kept(nevents, 0);
+		for (Long64_t ievt=0; ievt<nevents; ievt++) {
+			const Int_t signal = ievt % 4 == 0;
+			const Float_t inputs[nvar] = { Float_t(ievt), Float_t(signal) };
+			const Float_t weight = 0.5 + (ievt % 7)*0.25;
+			sumw[signal] += weight;
+			sampler.Add(inputs, signal, weight);
+		}
+		sampler.Finish();
+		const Long64_t quota[2] = { 3000, 1000 };
+		for (UInt_t iclass=0; iclass<2; iclass++) {
+			NB_CHECK(sampler.GetNSeen(iclass) == (iclass ? 20000 : 60000));
+			NB_CHECK(sampler.GetNKept(iclass) == quota[iclass]);
+			NB_CHECK_CLOSE(sampler.GetSumOfWeightsSeen(iclass), sumw[iclass], 1.e-6*sumw[iclass]);
+			// the rescaled kept weights keep the normalisation of the class
+			Double_t sumKept = 0, meanIndex = 0;
+			Bool_t classOk = kTRUE;
+			for (Long64_t i=0; i<sampler.GetNKept(iclass); i++) {
+				const Float_t* inputs = sampler.GetInputs(iclass, i);
+				sumKept += sampler.GetWeight(iclass, i);
+				meanIndex += inputs[0];
+				if (inputs[1] != iclass) classOk = kFALSE;
+				kept[Long64_t(inputs[0])]++;
+			}
+			NB_CHECK(classOk);
+			NB_CHECK_CLOSE(sumKept, sumw[iclass], 1.e-4*sumw[iclass]);
+			// uniform over the stream: early and late events are both kept
+			meanIndex /= sampler.GetNKept(iclass);
+			NB_CHECK_CLOSE(meanIndex, nevents/2., 0.05*nevents);
+		}
+		Bool_t unique = kTRUE;
+		for (Long64_t ievt=0; ievt<nevents; ievt++) if (kept[ievt] > 1) unique = kFALSE;
+		NB_CHECK(unique);
+
+		// a class below its quota is kept completely with its own weights
+		NeuroBayesDownsampler all(1, 10, 0);
+		const Float_t input = 1;
+		for (Int_t i=0; i<5; i++) all.Add(&input, 1, 2);
+		all.Add(&input, 0, 2);
+		all.Finish();
+		NB_CHECK(all.GetNKept(NeuroBayesDownsampler::kSignal) == 5);
+		NB_CHECK(all.GetScale(NeuroBayesDownsampler::kSignal) == 1);
+		NB_CHECK(all.GetNKept(NeuroBayesDownsampler::kBackground) == 0);
+		NB_CHECK(all.GetNSeen(NeuroBayesDownsampler::kBackground) == 1);
+	}
+
+	// r^T R^-1 r of the listed variables, by Gaussian elimination
+	Double_t TotalCorrelation( const std::vector<Double_t>& corr, const std::vector<Double_t>& target, UInt_t nvar,
+				   const std::vector<UInt_t>& vars ) {
+		const UInt_t n = vars.size();
+		std::vector<Double_t> a(n*(n + 1));
+		for (UInt_t i=0; i<n; i++) {
+			for (UInt_t j=0; j<n; j++) a[i*(n + 1) + j] = corr[vars[i]*nvar + vars[j]];
+			a[i*(n + 1) + n] = target[vars[i]];
+		}
+		for (UInt_t col=0; col<n; col++) {
+			UInt_t pivot = col;
+			for (UInt_t i=col+1; i<n; i++) if (std::fabs(a[i*(n + 1) + col]) > std::fabs(a[pivot*(n + 1) + col])) pivot = i;
+			for (UInt_t j=0; j<=n; j++) std::swap(a[col*(n + 1) + j], a[pivot*(n + 1) + j]);
+			for (UInt_t i=0; i<n; i++) {
+				if (i == col) continue;
+				const Double_t f = a[i*(n + 1) + col]/a[col*(n + 1) + col];
+				for (UInt_t j=col; j<=n; j++) a[i*(n + 1) + j] -= f*a[col*(n + 1) + j];
+			}
+		}
+		Double_t total = 0;
+		for (UInt_t i=0; i<n; i++) total += target[vars[i]]*a[i*(n + 1) + n]/a[i*(n + 1) + i];
+		return total;
+	}
+
+	void TestInputStatistics() {
+		// correlated inputs far from the origin, one of them nearly a copy
+		// of another, a target depending on two of them; events without
+		// positive weight do not count
+		const UInt_t nvar = 4;
+		const Int_t nevents = 5000;
+		Lcg lcg(99);
+		std::vector<Float_t> rows, targets, weights;
+		TMVA::NeuroBayesInputStatistics stats(nvar);
+		for (Int_t ievt=0; ievt<nevents; ievt++) {
+			const Double_t z1 = lcg.Uniform() - 0.5, z2 = lcg.Uniform() - 0.5, z3 = lcg.Uniform() - 0.5;
+			const Float_t inputs[nvar] = { Float_t(1000 + z1), Float_t(z1 + 0.5*z2), Float_t(z3), 
+						       Float_t(z1 + 0.5*z2 + 0.1*(lcg.Uniform() - 0.5)) };
+			const Float_t target = z1 + 0.3*z2 + 0.2*(lcg.Uniform() - 0.5) > 0 ? 1 : 0;
+			const Float_t weight = ievt % 50 == 0 ? -1 : ievt % 51 == 0 ? 0 : 0.5 + 1.5*lcg.Uniform();
+			stats.Fill(inputs, target, weight);
+			if (!(weight > 0)) continue;
+			rows.insert(rows.end(), inputs, inputs + nvar);
+			targets.push_back(target);
+			weights.push_back(weight);
+		}
+
+		// two passes: weighted means, then (co)variances around them
+		const UInt_t dim = nvar + 1, nkept = weights.size();
+		std::vector<Double_t> mean(dim, 0), cov(dim*dim, 0);
+		Double_t sumw = 0;
+		for (UInt_t ievt=0; ievt<nkept; ievt++) {
+			sumw += weights[ievt];
+			for (UInt_t i=0; i<dim; i++) mean[i] += weights[ievt]*(i < nvar ? rows[ievt*nvar + i] : targets[ievt]);
+		}
+		for (UInt_t i=0; i<dim; i++) mean[i] /= sumw;
+		for (UInt_t ievt=0; ievt<nkept; ievt++) {
+			for (UInt_t i=0; i<dim; i++) {
+				const Double_t di = (i < nvar ? rows[ievt*nvar + i] : targets[ievt]) - mean[i];
+				for (UInt_t j=0; j<dim; j++) {
+					const Double_t dj = (j < nvar ? rows[ievt*nvar + j] : targets[ievt]) - mean[j];
+					cov[i*dim + j] += weights[ievt]*di*dj/sumw;
+				}
+			}
+		}
+		NB_CHECK(stats.GetNEvents() == nkept);
+		NB_CHECK_CLOSE(stats.GetSumOfWeights(), sumw, 1.e-9*sumw);
+		std::vector<Double_t> corr(nvar*nvar), target(nvar);
+		for (UInt_t i=0; i<dim; i++) {
+			NB_CHECK_CLOSE(stats.GetMean(i), mean[i], 1.e-9*(1 + std::fabs(mean[i])));
+			NB_CHECK_CLOSE(stats.GetVariance(i), cov[i*dim + i], 1.e-9*cov[i*dim + i]);
+			for (UInt_t j=0; j<dim; j++) {
+				const Double_t expected = cov[i*dim + j]/std::sqrt(cov[i*dim + i]*cov[j*dim + j]);
+				NB_CHECK_CLOSE(stats.GetCorrelation(i, j), expected, 1.e-9);
+				if (i < nvar && j < nvar) corr[i*nvar + j] = expected;
+				if (i < nvar && j == nvar) target[i] = expected;
+			}
+		}
+		NB_CHECK(stats.GetCorrelation(1, 3) > 0.9);
+
+		// ranking: remove the variable losing least, recomputing the total
+		// correlation of the remaining ones from scratch at every step
+		Double_t total;
+		std::vector<Double_t> loss;
+		NB_CHECK(stats.GetCorrelationLoss(total, loss));
+		std::vector<UInt_t> active;
+		for (UInt_t i=0; i<nvar; i++) active.push_back(i);
+		NB_CHECK_CLOSE(total, TotalCorrelation(corr, target, nvar, active), 1.e-6);
+		std::vector<UInt_t> order;
+		while (!active.empty()) {
+			const Double_t all = TotalCorrelation(corr, target, nvar, active);
+			UInt_t kmin = 0;
+			Double_t lmin = 0;
+			for (UInt_t k=0; k<active.size(); k++) {
+				std::vector<UInt_t> rest(active);
+				rest.erase(rest.begin() + k);
+				const Double_t l = all - (rest.empty() ? 0 : TotalCorrelation(corr, target, nvar, rest));
+				if (k == 0 || l < lmin) {
+					kmin = k;
+					lmin = l;
+				}
+			}
+			NB_CHECK_CLOSE(loss[active[kmin]], lmin, 1.e-6);
+			order.push_back(active[kmin]);
+			active.erase(active.begin() + kmin);
+		}
+		// the constant-offset variable is the most important one, of the
+		// near copies the first removed loses little
+		NB_CHECK(order.back() == 0);
+		NB_CHECK(std::min(loss[1], loss[3]) < 0.1*std::max(loss[1], loss[3]));
+	}
+
+	void TestProfiler() {
+		using TMVA::NeuroBayesProfiler;
+		NeuroBayesProfiler profiler(2);
+
+		// below four ns the bins are exact
+		for (Long64_t ns=0; ns<4; ns++) {
+			profiler.Reset();
+			profiler.Fill(0, NeuroBayesProfiler::kExpert, ns);
+			NB_CHECK(profiler.GetSummary(NeuroBayesProfiler::kExpert).p50 == ns);
+		}
+
+		// a single value: its bin is at most 1/8 of the value wide on
+		// either side of the center, and the quantile never exceeds the max
+		const Long64_t values[6] = { 4, 7, 100, 1000, 123457, 5000000000LL };
+		for (UInt_t i=0; i<6; i++) {
+			profiler.Reset();
+			profiler.Fill(1, NeuroBayesProfiler::kBatch, values[i]);
+			const NeuroBayesProfiler::Summary summary = profiler.GetSummary(NeuroBayesProfiler::kBatch);
+			NB_CHECK(summary.p50 <= values[i]);
+			NB_CHECK_CLOSE(summary.p50, values[i], 0.125*values[i]);
+			NB_CHECK(summary.max == values[i]);
+		}
+
+		// 1..10000 ns split over both slots, the second one in blocks
+		profiler.Reset();
+		for (Long64_t ns=1; ns<=10000; ns++) {
+			if (ns % 2) profiler.Fill(0, NeuroBayesProfiler::kGather, ns);
+			else profiler.Fill(1, NeuroBayesProfiler::kGather, ns, 1);
+		}
+		profiler.Fill(1, NeuroBayesProfiler::kGather, 5000, 0); // an empty block counts as a call only
+		const NeuroBayesProfiler::Summary summary = profiler.GetSummary(NeuroBayesProfiler::kGather);
+		NB_CHECK(summary.calls == 10001);
+		NB_CHECK(summary.entries == 10000);
+		NB_CHECK(profiler.GetEntries(0, NeuroBayesProfiler::kGather) == 5000);
+		NB_CHECK_CLOSE(summary.mean, 5000.5, 1.e-9);
+		NB_CHECK(summary.max == 10000);
+		NB_CHECK_CLOSE(summary.p50, 5000, 0.125*5000);
+		NB_CHECK_CLOSE(summary.p90, 9000, 0.125*9000);
+		NB_CHECK_CLOSE(summary.p99, 9900, 0.125*9900);
+		NB_CHECK(summary.p50 <= summary.p90 && summary.p90 <= summary.p99 && summary.p99 <= summary.max);
+
+		// untouched channels stay empty
+		NB_CHECK(profiler.GetSummary(NeuroBayesProfiler::kReadWeights).entries == 0);
+	}
+}
+
+int main()
+{
+	TestNativeNet();
+	TestNativeNetRejects();
+	TestHalf();
+	TestQuantizedNet();
+	TestDownsampler();
+	TestInputStatistics();
+	TestProfiler();
+	printf("%d checks, %d failed\n", gChecks, gFailures);
+	return gFailures == 0 ? 0 : 1;
+}